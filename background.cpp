@@ -0,0 +1,221 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include <chrono>
+
+#include <hexrays.hpp>
+#include <auto.hpp>
+#include <ua.hpp>
+#include "background.hpp"
+
+const int BG_WAIT_INTERVAL = 1000;  // ms, while waiting for the autoanalysis or the user
+const int BG_SCAN_INTERVAL = 10;    // ms, between two ranking slices
+const int BG_SCAN_SLICE = 50;       // ms, max duration of a ranking slice
+const int BG_MIN_INTERVAL = 100;    // ms, between two decompilations
+const int BG_REPORT_FREQ = 10;      // how often the progress is reported, in functions
+// functions with fewer mixed instructions are unlikely to contain MBAs
+const int BG_MIN_MIXED_INSNS = 8;
+
+//-------------------------------------------------------------------------
+static uint64 now_ms()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//-------------------------------------------------------------------------
+static bool is_one_of(const qstring &mnem, const char *const *list, size_t n)
+{
+  for ( size_t i = 0; i < n; i++ )
+    if ( mnem == list[i] )
+      return true;
+  return false;
+}
+
+//-------------------------------------------------------------------------
+// a cheap estimate of how likely the function contains MBA expressions,
+// in per mille: MBAs mix boolean and arithmetic operations, so the smaller
+// of both counts relative to the function size is used.
+// the mnemonics of common processors are enough for ranking.
+static int estimate_mba_density(func_t *pfn)
+{
+  static const char *const bool_mnems[] =
+  {
+    "and", "andn", "or", "xor", "not", "nor",
+    "ands", "orr", "orn", "eor", "eors", "bic", "mvn",
+  };
+  static const char *const arith_mnems[] =
+  {
+    "add", "adc", "sub", "sbb", "neg", "mul", "imul", "lea", "shl", "sal",
+    "adds", "subs", "rsb", "madd", "msub", "lsl", "addu", "subu",
+  };
+
+  int nbool = 0;
+  int narith = 0;
+  int ninsns = 0;
+  func_item_iterator_t fii;
+  for ( bool ok = fii.set(pfn); ok; ok = fii.next_code() )
+  {
+    insn_t insn;
+    if ( decode_insn(&insn, fii.current()) <= 0 )
+      continue;
+    ninsns++;
+    qstring mnem;
+    if ( !print_insn_mnem(&mnem, insn.ea) )
+      continue;
+    if ( is_one_of(mnem, bool_mnems, qnumber(bool_mnems)) )
+      nbool++;
+    else if ( is_one_of(mnem, arith_mnems, qnumber(arith_mnems)) )
+      narith++;
+  }
+  int nmixed = qmin(nbool, narith);
+  if ( nmixed < BG_MIN_MIXED_INSNS )
+    return 0;
+  return 1000 * 2 * nmixed / ninsns;
+}
+
+//-------------------------------------------------------------------------
+void background_simplifier_t::start(const plugmod_t *owner)
+{
+  if ( !enabled || timer != nullptr )
+    return;
+  hook_event_listener(HT_VIEW, this, owner);
+  state = BG_WAIT;
+  timer = register_timer(BG_WAIT_INTERVAL, timer_cb, this);
+}
+
+//-------------------------------------------------------------------------
+void background_simplifier_t::stop()
+{
+  if ( timer != nullptr )
+  {
+    unregister_timer(timer);
+    timer = nullptr;
+  }
+  unhook_event_listener(HT_VIEW, this);
+}
+
+//-------------------------------------------------------------------------
+ssize_t idaapi background_simplifier_t::on_event(ssize_t code, va_list)
+{
+  switch ( code )
+  {
+    case view_activated:
+    case view_switched:
+    case view_keydown:
+    case view_click:
+    case view_dblclick:
+    case view_curpos:
+      last_interaction = now_ms();
+      break;
+    default:
+      break;
+  }
+  return 0;
+}
+
+//-------------------------------------------------------------------------
+int idaapi background_simplifier_t::timer_cb(void *ud)
+{
+  background_simplifier_t *bg = (background_simplifier_t *)ud;
+  int interval = bg->tick();
+  if ( interval < 0 )
+    bg->timer = nullptr; // the timer is unregistered by the kernel
+  return interval;
+}
+
+//-------------------------------------------------------------------------
+// returns the delay until the next tick, -1 when all work is done
+int background_simplifier_t::tick()
+{
+  if ( !auto_is_ok() )
+    return BG_WAIT_INTERVAL;
+  if ( now_ms() - last_interaction < uint64(idle_delay) * 1000 )
+    return BG_WAIT_INTERVAL;
+
+  switch ( state )
+  {
+    case BG_WAIT:
+      done_node = netnode("$ goomba background", 0, true);
+      nscanned = 0;
+      queue.clear();
+      state = BG_SCAN;
+      msg("goomba: background: ranking %" FMT_Z " functions\n", get_func_qty());
+      return BG_SCAN_INTERVAL;
+
+    case BG_SCAN:
+      scan_slice();
+      if ( nscanned < get_func_qty() )
+        return BG_SCAN_INTERVAL;
+      std::stable_sort(queue.begin(), queue.end(),
+                       [](const auto &a, const auto &b) { return a.first > b.first; });
+      next = 0;
+      nfailed = 0;
+      state = BG_SIMPLIFY;
+      msg("goomba: background: %" FMT_Z " functions to simplify\n", queue.size());
+      return BG_MIN_INTERVAL;
+
+    case BG_SIMPLIFY:
+      if ( next < queue.size() )
+      {
+        uint64 started = now_ms();
+        simplify_next();
+        uint64 elapsed = now_ms() - started;
+        // keep the share of the background work below 'load'
+        uint64 pause = elapsed * (100 - load) / qmax(load, 1);
+        return int(qmax(pause, uint64(BG_MIN_INTERVAL)));
+      }
+      msg("goomba: background: done, %" FMT_Z " functions processed, %d failed to decompile\n",
+          queue.size(), nfailed);
+      state = BG_DONE;
+      return -1;
+
+    case BG_DONE:
+    default:
+      return -1;
+  }
+}
+
+//-------------------------------------------------------------------------
+// ranks the next batch of functions
+void background_simplifier_t::scan_slice()
+{
+  uint64 started = now_ms();
+  size_t qty = get_func_qty();
+  while ( nscanned < qty && now_ms() - started < BG_SCAN_SLICE )
+  {
+    func_t *pfn = getn_func(nscanned++);
+    if ( pfn == nullptr || (pfn->flags & (FUNC_LIB|FUNC_THUNK)) != 0 )
+      continue;
+    if ( done_node.altval(pfn->start_ea) != 0 )
+      continue; // processed in a previous session
+    int density = estimate_mba_density(pfn);
+    if ( density > 0 )
+      queue.push_back({ density, pfn->start_ea });
+  }
+}
+
+//-------------------------------------------------------------------------
+void background_simplifier_t::simplify_next()
+{
+  ea_t ea = queue[next++].second;
+  func_t *pfn = get_func(ea);
+  if ( pfn != nullptr && pfn->start_ea == ea )
+  {
+    hexrays_failure_t hf;
+    decompiling = true;
+    cfuncptr_t cfunc = decompile_func(pfn, &hf, DECOMP_NO_WAIT | DECOMP_NO_CACHE);
+    decompiling = false;
+    if ( cfunc == nullptr )
+      nfailed++;
+  }
+  done_node.altset(ea, 1);
+
+  if ( next % BG_REPORT_FREQ == 0 || next == queue.size() )
+    msg("goomba: background: processed %" FMT_Z "/%" FMT_Z " functions\n", next, queue.size());
+}
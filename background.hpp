@@ -0,0 +1,53 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+// ms, the time budget of the optimizer in a background decompilation. the
+// decompilation blocks the user interface and cannot see the user actions,
+// so a user who starts working meanwhile waits for up to this long.
+const uint BG_FUNC_TIME_BUDGET = 200;
+
+//-------------------------------------------------------------------------
+// decompiles the functions of the database while IDA is idle, so that the
+// results of the optimizer are already in the database (see idb_store.hpp)
+// when the user opens a function.
+// the functions are ranked by a cheap estimate of MBA density computed from
+// the disassembly. the work is done in a timer, one function per tick, and
+// takes at most 'load' percent of the time. it pauses while the user is
+// interacting with IDA. processed functions are remembered in the database,
+// so the work resumes where it stopped in the next session.
+class background_simplifier_t : public event_listener_t
+{
+  enum state_t { BG_WAIT, BG_SCAN, BG_SIMPLIFY, BG_DONE };
+  state_t state = BG_WAIT;
+  qtimer_t timer = nullptr;
+  netnode done_node;          // altvals: processed functions
+  size_t nscanned = 0;        // number of functions ranked so far
+  qvector<std::pair<int, ea_t>> queue; // density and address, the densest first
+  size_t next = 0;            // next function in the queue
+  uint64 last_interaction = 0; // time of the last user action, ms
+  int nfailed = 0;
+
+  static int idaapi timer_cb(void *ud);
+  int tick();
+  void scan_slice();
+  void simplify_next();
+
+public:
+  bool enabled = false;
+  int load = 25;              // max share of the time spent by the background work, %
+  int idle_delay = 5;         // seconds without user actions before resuming
+  bool decompiling = false;   // a background decompilation is in progress
+
+  ~background_simplifier_t() { stop(); }
+  void start(const plugmod_t *owner);
+  void stop();
+  virtual ssize_t idaapi on_event(ssize_t code, va_list va) override;
+};
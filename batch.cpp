@@ -0,0 +1,298 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include <chrono>
+
+#include <hexrays.hpp>
+#include <auto.hpp>
+#include <fpro.h>
+#include <diskio.hpp>
+#include <loader.hpp>
+#include "batch.hpp"
+
+// starts the header line of a function in the worker files.
+// the lines of the pseudocode that follow are indented by two spaces.
+#define BATCH_FUNC_TAG "@func "
+
+#ifdef __NT__
+#define BATCH_IDAT_NAME "idat.exe"
+#else
+#define BATCH_IDAT_NAME "idat"
+#endif
+
+//-------------------------------------------------------------------------
+// results of one function, as written by a worker
+struct batch_func_t
+{
+  ea_t ea = BADADDR;
+  int ok = 0;
+  int nimproved = 0;
+  int64 usecs = 0;
+  qstring name;
+  qstring text;   // pseudocode or error message
+};
+typedef std::map<ea_t, batch_func_t> batch_funcs_t;
+
+//-------------------------------------------------------------------------
+static qstring get_worker_path(const char *report_path, int index)
+{
+  qstring path;
+  path.sprnt("%s.%d", report_path, index);
+  return path;
+}
+
+//-------------------------------------------------------------------------
+bool batch_t::run_worker(int index, int nworkers, const char *report_path)
+{
+  FILE *fout = qfopen(report_path, "w");
+  if ( fout == nullptr )
+  {
+    msg("%s: %s\n", report_path, qstrerror(-1));
+    return false;
+  }
+
+  worker = true;
+  auto_wait();
+  size_t qty = get_func_qty();
+  msg("goomba: batch worker %d/%d: decompiling %" FMT_Z " functions\n",
+      index, nworkers, (qty + nworkers - 1 - index) / nworkers);
+  for ( size_t i = index; i < qty; i += nworkers )
+  {
+    func_t *pfn = getn_func(i);
+    if ( pfn == nullptr )
+      continue;
+    qstring name;
+    get_func_name(&name, pfn->start_ea);
+
+    nimproved = 0;
+    hexrays_failure_t hf;
+    auto start = std::chrono::high_resolution_clock::now();
+    cfuncptr_t cfunc = decompile_func(pfn, &hf, DECOMP_NO_WAIT | DECOMP_NO_CACHE);
+    auto end = std::chrono::high_resolution_clock::now();
+    int64 usecs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    qfprintf(fout, BATCH_FUNC_TAG "%" FMT_64 "x %d %d %" FMT_64 "d %s\n",
+             uint64(pfn->start_ea), cfunc != nullptr, nimproved, usecs, name.c_str());
+    if ( cfunc != nullptr )
+    {
+      const strvec_t &sv = cfunc->get_pseudocode();
+      for ( const simpleline_t &sl : sv )
+      {
+        qstring line;
+        tag_remove(&line, sl.line.c_str());
+        qfprintf(fout, "  %s\n", line.c_str());
+      }
+    }
+    else
+    {
+      qfprintf(fout, "  // %a: %s\n", hf.errea, hf.desc().c_str());
+    }
+  }
+  worker = false;
+  return qfclose(fout) == 0;
+}
+
+//-------------------------------------------------------------------------
+static bool read_worker_file(batch_funcs_t *funcs, const char *path)
+{
+  FILE *fin = qfopen(path, "r");
+  if ( fin == nullptr )
+  {
+    msg("%s: %s\n", path, qstrerror(-1));
+    return false;
+  }
+
+  batch_func_t *cur = nullptr;
+  qstring line;
+  while ( qgetline(&line, fin) >= 0 )
+  {
+    if ( strneq(line.c_str(), BATCH_FUNC_TAG, sizeof(BATCH_FUNC_TAG) - 1) )
+    {
+      batch_func_t f;
+      uint64 ea;
+      int name_off = 0;
+      if ( qsscanf(line.c_str() + sizeof(BATCH_FUNC_TAG) - 1,
+                   "%" FMT_64 "x %d %d %" FMT_64 "d %n",
+                   &ea, &f.ok, &f.nimproved, &f.usecs, &name_off) < 4 )
+      {
+        cur = nullptr;
+        continue;
+      }
+      f.ea = ea_t(ea);
+      f.name = line.c_str() + sizeof(BATCH_FUNC_TAG) - 1 + name_off;
+      cur = &(*funcs)[f.ea];
+      *cur = f;
+    }
+    else if ( cur != nullptr )
+    {
+      cur->text.append(line.c_str() + qmin(line.length(), size_t(2)));
+      cur->text.append('\n');
+    }
+  }
+  qfclose(fin);
+  return true;
+}
+
+//-------------------------------------------------------------------------
+static bool write_report(
+        const char *report_path,
+        const batch_funcs_t &funcs,
+        int nworkers,
+        int64 wall_usecs)
+{
+  FILE *fout = qfopen(report_path, "w");
+  if ( fout == nullptr )
+  {
+    msg("%s: %s\n", report_path, qstrerror(-1));
+    return false;
+  }
+
+  size_t ndecompiled = 0;
+  size_t nsimplified = 0;
+  int nimproved = 0;
+  int64 usecs = 0;
+  for ( const auto &p : funcs )
+  {
+    const batch_func_t &f = p.second;
+    ndecompiled += f.ok != 0;
+    nsimplified += f.nimproved != 0;
+    nimproved += f.nimproved;
+    usecs += f.usecs;
+  }
+
+  qfprintf(fout, "gooMBA batch report for %s\n\n", qbasename(get_path(PATH_TYPE_IDB)));
+  qfprintf(fout, "functions:                %" FMT_Z "\n", funcs.size());
+  qfprintf(fout, "decompiled:               %" FMT_Z "\n", ndecompiled);
+  qfprintf(fout, "failed:                   %" FMT_Z "\n", funcs.size() - ndecompiled);
+  qfprintf(fout, "with simplified MBAs:     %" FMT_Z "\n", nsimplified);
+  qfprintf(fout, "simplified expressions:   %d\n", nimproved);
+  qfprintf(fout, "decompilation time:       %" FMT_64 "d ms\n", usecs / 1000);
+  qfprintf(fout, "wall time with %d workers: %" FMT_64 "d ms\n\n", nworkers, wall_usecs / 1000);
+
+  qfprintf(fout, "%-18s %-6s %6s %10s  %s\n", "address", "status", "mbas", "time_ms", "name");
+  for ( const auto &p : funcs )
+  {
+    const batch_func_t &f = p.second;
+    qstring addr;
+    addr.sprnt("%a", f.ea);
+    qfprintf(fout, "%-18s %-6s %6d %10" FMT_64 "d  %s\n",
+             addr.c_str(), f.ok ? "ok" : "failed", f.nimproved, f.usecs / 1000, f.name.c_str());
+  }
+  bool ok = qfclose(fout) == 0;
+
+  qstring code_path(report_path);
+  code_path.append(".c");
+  fout = qfopen(code_path.c_str(), "w");
+  if ( fout == nullptr )
+  {
+    msg("%s: %s\n", code_path.c_str(), qstrerror(-1));
+    return false;
+  }
+  for ( const auto &p : funcs )
+  {
+    const batch_func_t &f = p.second;
+    qfprintf(fout, "//----- (%a) %s\n%s\n", f.ea, f.name.c_str(), f.text.c_str());
+  }
+  return qfclose(fout) == 0 && ok;
+}
+
+//-------------------------------------------------------------------------
+bool batch_t::run_coordinator(int nworkers, const char *report_path)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  auto_wait();
+
+  // all workers start from the same snapshot of the analyzed database
+  const char *ext = get_file_ext(get_path(PATH_TYPE_IDB));
+  qstring snapshot;
+  snapshot.sprnt("%s.snapshot.%s", report_path, ext != nullptr ? ext : "i64");
+  if ( !save_database(snapshot.c_str(), DBFL_COMP) )
+  {
+    msg("%s: failed to save the database\n", snapshot.c_str());
+    return false;
+  }
+
+  qstring idat;
+  if ( !qgetenv("VD_MBA_BATCH_IDAT", &idat) )
+  {
+    char buf[QMAXPATH];
+    qmakepath(buf, sizeof(buf), idadir(nullptr), BATCH_IDAT_NAME, nullptr);
+    idat = buf;
+  }
+
+  qvector<void *> handles;
+  qstrvec_t dbs;
+  for ( int k = 0; k < nworkers; k++ )
+  {
+    qstring db;
+    db.sprnt("%s.%d.%s", report_path, k, ext != nullptr ? ext : "i64");
+    if ( qcopyfile(snapshot.c_str(), db.c_str()) != 0 )
+    {
+      msg("%s: %s\n", db.c_str(), qstrerror(-1));
+      break;
+    }
+    dbs.push_back(db);
+
+    // the workers inherit the environment
+    qstring worker_path = get_worker_path(report_path, k);
+    qstring spec;
+    spec.sprnt("%d/%d", k, nworkers);
+    qsetenv("VD_MBA_BATCH_WORKER", spec.c_str());
+    qsetenv("VD_MBA_BATCH_REPORT", worker_path.c_str());
+
+    qstring args;
+    args.sprnt("-A \"-L%s.log\" \"%s\"", worker_path.c_str(), db.c_str());
+    launch_process_params_t lpp;
+    lpp.path = idat.c_str();
+    lpp.args = args.c_str();
+    lpp.flags = LP_HIDE_WINDOW;
+    qstring errbuf;
+    void *handle = launch_process(lpp, &errbuf);
+    if ( handle == nullptr )
+    {
+      msg("%s: failed to launch worker %d: %s\n", idat.c_str(), k, errbuf.c_str());
+      break;
+    }
+    handles.push_back(handle);
+  }
+  msg("goomba: batch: launched %" FMT_Z " workers\n", handles.size());
+
+  bool ok = handles.size() == size_t(nworkers);
+  for ( size_t k = 0; k < handles.size(); k++ )
+  {
+    int code = -1;
+    check_process_exit(handles[k], &code, -1);
+    if ( code != 0 )
+    {
+      msg("goomba: batch: worker %" FMT_Z " exited with code %d, see %s.log\n",
+          k, code, get_worker_path(report_path, k).c_str());
+      ok = false;
+    }
+  }
+
+  // merge whatever the workers produced, even if some of them failed
+  batch_funcs_t funcs;
+  for ( size_t k = 0; k < handles.size(); k++ )
+  {
+    qstring worker_path = get_worker_path(report_path, k);
+    if ( read_worker_file(&funcs, worker_path.c_str()) )
+      qunlink(worker_path.c_str());
+    else
+      ok = false;
+  }
+  for ( const qstring &db : dbs )
+    qunlink(db.c_str());
+  qunlink(snapshot.c_str());
+
+  auto end = std::chrono::high_resolution_clock::now();
+  int64 wall_usecs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  if ( !write_report(report_path, funcs, nworkers, wall_usecs) )
+    return false;
+  msg("goomba: batch: %" FMT_Z " functions, report written to %s\n", funcs.size(), report_path);
+  return ok;
+}
@@ -0,0 +1,31 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+//-------------------------------------------------------------------------
+// headless decompilation of the whole database by a pool of idat processes.
+// the coordinator saves a snapshot of the database, makes a copy of it for
+// every worker, and launches the workers. worker #k decompiles the functions
+// whose number modulo N equals k and writes the results to its own file.
+// when all workers exit, the coordinator merges their files into the final
+// report (statistics) and the pseudocode file (report path + ".c").
+//
+// the coordinator is started with VD_MBA_BATCH_WORKERS=N and
+// VD_MBA_BATCH_REPORT=<report path>. the workers are given their number and
+// the path of their file in VD_MBA_BATCH_WORKER ("k/N") and VD_MBA_BATCH_REPORT.
+class batch_t
+{
+public:
+  bool worker = false;  // running as a worker: only the dense functions are optimized, see is_dense()
+  int nimproved = 0;    // expressions improved by the optimizer, updated by hxe_glbopt
+
+  bool run_coordinator(int nworkers, const char *report_path);
+  bool run_worker(int index, int nworkers, const char *report_path);
+};
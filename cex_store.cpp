@@ -0,0 +1,95 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "cex_store.hpp"
+#include "idb_store.hpp"
+
+// version of the blob layout, increment on incompatible changes
+const uint32 CEX_STORE_VERSION = 1;
+// netnode blob tag
+const uchar CEX_STORE_TAG = 'C';
+
+#define CEX_STORE_NODE_NAME "$ goomba counterexamples"
+
+//-------------------------------------------------------------------------
+void cex_store_t::load()
+{
+  loaded = true;
+  node = netnode(CEX_STORE_NODE_NAME);
+  if ( node == BADNODE )
+    return;
+
+  bytevec_t blob;
+  if ( node.getblob(&blob, 0, CEX_STORE_TAG) <= 0 )
+    return;
+
+  blob_reader_t r(blob);
+  uint32 version;
+  uint32 ncexes;
+  if ( !r.read(&version) || version != CEX_STORE_VERSION || !r.read(&ncexes) )
+  {
+    dirty = true;
+    return;
+  }
+  for ( uint32 i = 0; i < ncexes; i++ )
+  {
+    uint32 nvals;
+    if ( !r.read(&nvals) || nvals > (r.end - r.ptr) / sizeof(uint64) )
+      break; // truncated, keep what was read
+    cex_t cex;
+    cex.resize(nvals);
+    for ( uint64 &v : cex )
+      r.read(&v);
+    cexes.push_back(cex);
+  }
+}
+
+//-------------------------------------------------------------------------
+const cexes_t &cex_store_t::get()
+{
+  if ( !loaded && enabled )
+    load();
+  return cexes;
+}
+
+//-------------------------------------------------------------------------
+void cex_store_t::add(const cex_t &cex)
+{
+  if ( !enabled || cex.empty() )
+    return;
+  if ( !loaded )
+    load();
+  if ( cexes.has(cex) )
+    return;
+  if ( cexes.size() >= MAX_COUNTEREXAMPLES )
+    cexes.erase(cexes.begin());
+  cexes.push_back(cex);
+  dirty = true;
+}
+
+//-------------------------------------------------------------------------
+void cex_store_t::save()
+{
+  if ( !dirty )
+    return;
+  dirty = false;
+
+  if ( node == BADNODE )
+    node.create(CEX_STORE_NODE_NAME);
+
+  bytevec_t blob;
+  append_raw(&blob, CEX_STORE_VERSION);
+  append_raw(&blob, uint32(cexes.size()));
+  for ( const cex_t &cex : cexes )
+  {
+    append_raw(&blob, uint32(cex.size()));
+    for ( uint64 v : cex )
+      append_raw(&blob, v);
+  }
+  node.setblob(blob.begin(), blob.size(), 0, CEX_STORE_TAG);
+}
@@ -0,0 +1,43 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+// how many counterexamples are kept, the oldest ones are dropped first
+const int MAX_COUNTEREXAMPLES = 64;
+
+//-------------------------------------------------------------------------
+// the values of the input variables of an expression, in the order of
+// their first occurrence (see get_input_mops_by_occurrence)
+typedef qvector<uint64> cex_t;
+typedef qvector<cex_t> cexes_t;
+
+//-------------------------------------------------------------------------
+// inputs that told an expression apart from a wrong candidate, taken from
+// the z3 models. wrong candidates tend to fail on the same corner cases,
+// so the candidates of every expression are tested on these inputs before
+// the random ones, and the SMT call is spared.
+// the counterexamples are kept in the database, in a single netnode blob.
+class cex_store_t
+{
+  netnode node;
+  cexes_t cexes;      // the oldest first
+  bool loaded = false;
+  bool dirty = false;
+
+  void load();
+
+public:
+  bool enabled = true;
+
+  const cexes_t &get();
+  void add(const cex_t &cex);
+  // writes the counterexamples to the database if they were modified
+  void save();
+};
@@ -0,0 +1,139 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "dag.hpp"
+
+//-------------------------------------------------------------------------
+struct dag_builder_t
+{
+  mblock_t *blk;            // the block of the top-level instruction
+  const minsn_t *top;       // the top-level instruction
+  mblock_t *pred = nullptr; // the only predecessor of blk, if any
+  int ninlined = 0;
+
+  dag_builder_t(mblock_t *b, const minsn_t *t) : blk(b), top(t)
+  {
+    if ( blk->npred() == 1 )
+    {
+      pred = blk->mba->get_mblock(blk->pred(0));
+      if ( pred == blk )
+        pred = nullptr; // a loop of one block
+    }
+  }
+
+  //-------------------------------------------------------------------------
+  // the combined expression is evaluated at 'top', so the inputs of each
+  // definition must hold the same values from the definition to 'top'
+  bool inputs_kept(const minsn_t *def, const mblock_t *b) const
+  {
+    mlist_t uses = b->build_use_list(*def, MAY_ACCESS);
+    if ( b == blk )
+      return !blk->is_redefined(uses, def->next, top);
+    return !pred->is_redefined(uses, def->next, nullptr)
+        && !blk->is_redefined(uses, blk->head, top);
+  }
+
+  //-------------------------------------------------------------------------
+  // finds the instruction that defines 'op' before 'pos', an instruction
+  // of block '*b'. when 'pos' is in the top-level block and the operand is
+  // not defined there, the definition is looked for in the only predecessor
+  // of the block, and '*b' is updated. returns nullptr if the definition
+  // cannot be combined with 'top'.
+  const minsn_t *find_def(const mop_t &op, const minsn_t *pos, mblock_t **b) const
+  {
+    mlist_t oplist;
+    blk->append_use_list(&oplist, op, MUST_ACCESS);
+    mblock_t *cur = *b;
+    const minsn_t *p = pos->prev;
+    while ( true )
+    {
+      if ( p == nullptr )
+      {
+        if ( cur != blk || pred == nullptr )
+          return nullptr;
+        cur = pred;
+        p = pred->tail;
+        continue;
+      }
+      mlist_t def = cur->build_def_list(*p, MAY_ACCESS);
+      if ( def.has_common(oplist) )
+        break;
+      p = p->prev;
+    }
+    // the closest definition must define exactly this operand
+    if ( p->d != op
+      || p->opcode >= m_jcnd
+      || p->has_side_effects(true)
+      || !inputs_kept(p, cur) )
+    {
+      return nullptr;
+    }
+    *b = cur;
+    return p;
+  }
+
+  //-------------------------------------------------------------------------
+  // replaces the variables of 'insn' with their definitions before 'pos',
+  // an instruction of block 'b'
+  void inline_defs(minsn_t *insn, const minsn_t *pos, mblock_t *b, int depth)
+  {
+    struct ida_local var_collector_t : public mop_visitor_t
+    {
+      qvector<mop_t *> vars;
+      int idaapi visit_mop(mop_t *op, const tinfo_t *, bool is_target) override
+      {
+        if ( !is_target && (op->t == mop_r || op->t == mop_S) )
+          vars.push_back(op);
+        return 0;
+      }
+    };
+    var_collector_t vc;
+    insn->for_all_ops(vc);
+
+    for ( mop_t *op : vc.vars )
+    {
+      if ( ninlined >= DAG_MAX_INLINED )
+        break;
+      mblock_t *defblk = b;
+      const minsn_t *def = find_def(*op, pos, &defblk);
+      if ( def == nullptr )
+        continue;
+      ninlined++;
+      if ( def->opcode == m_mov )
+      {
+        *op = def->l;
+        if ( op->is_insn() && depth < DAG_MAX_DEPTH )
+          inline_defs(op->d, def, defblk, depth + 1);
+      }
+      else
+      {
+        op->create_from_insn(def);
+        if ( depth < DAG_MAX_DEPTH )
+          inline_defs(op->d, def, defblk, depth + 1);
+      }
+    }
+  }
+};
+
+//-------------------------------------------------------------------------
+minsn_t *build_insn_dag(mblock_t *blk, const minsn_t &insn)
+{
+  if ( insn.opcode >= m_jcnd || insn.has_side_effects(true) )
+    return nullptr;
+
+  minsn_t *dag = new minsn_t(insn);
+  dag_builder_t builder(blk, &insn);
+  builder.inline_defs(dag, &insn, blk, 1);
+  if ( builder.ninlined == 0 )
+  {
+    delete dag;
+    return nullptr;
+  }
+  dag->optimize_solo();
+  return dag;
+}
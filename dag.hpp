@@ -0,0 +1,34 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+// how deep the definitions are followed from the instruction
+const int DAG_MAX_DEPTH = 4;
+// the maximal number of definitions combined into one expression
+const int DAG_MAX_INLINED = 16;
+
+//-------------------------------------------------------------------------
+// when the decompiler does not propagate an MBA expression into a single
+// instruction, its parts stay in separate instructions of the block:
+//   t1 = x ^ y
+//   t2 = x & y
+//   z  = t1 + 2*t2
+// this function combines the top-level instruction with the definitions of
+// its operands that precede it in the block, giving z = (x^y) + 2*(x&y).
+// the definitions are also looked for at the end of the only predecessor
+// of the block, whose instructions always run right before the block.
+// a definition is combined only if it is the last one before the use, has
+// no side effects, and its own operands are not modified until the
+// top-level instruction, so the combined expression computes the same value
+// as the instruction.
+// returns nullptr if no definitions could be combined.
+// the definitions themselves are left intact: once the instruction is
+// replaced by a simpler one, the decompiler removes those that became dead.
+minsn_t *build_insn_dag(mblock_t *blk, const minsn_t &insn);
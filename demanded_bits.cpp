@@ -0,0 +1,87 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "demanded_bits.hpp"
+
+static void demand_insn(var_widths_t *out, const minsn_t &insn, int bits);
+
+//-------------------------------------------------------------------------
+// the low 'bits' bits of the operand are demanded
+static void demand_mop(var_widths_t *out, const mop_t &op, int bits)
+{
+  bits = qmin(bits, op.size * 8);
+  if ( bits <= 0 )
+    return;
+  switch ( op.t )
+  {
+    case mop_d:
+      demand_insn(out, *op.d, bits);
+      break;
+    case mop_r:
+    case mop_S:
+    case mop_v:
+    case mop_l:
+      {
+        int &width = (*out)[op];
+        width = qmax(width, bits);
+      }
+      break;
+    case mop_p:
+      demand_mop(out, op.pair->lop, op.pair->lop.size * 8);
+      demand_mop(out, op.pair->hop, op.pair->hop.size * 8);
+      break;
+    default:
+      break; // constants
+  }
+}
+
+//-------------------------------------------------------------------------
+static void demand_insn(var_widths_t *out, const minsn_t &insn, int bits)
+{
+  switch ( insn.opcode )
+  {
+    case m_ldc:
+    case m_mov:
+    case m_neg:
+    case m_bnot:
+    case m_add:
+    case m_sub:
+    case m_mul:
+    case m_and:
+    case m_or:
+    case m_xor:
+      // the carries only go up
+      demand_mop(out, insn.l, bits);
+      demand_mop(out, insn.r, bits);
+      break;
+    case m_low:
+    case m_xdu:
+    case m_xds:
+      // the sign bit of xds is demanded only if the extension is
+      demand_mop(out, insn.l, bits);
+      break;
+    case m_shl:
+      if ( insn.r.t == mop_n )
+        demand_mop(out, insn.l, bits - int(qmin<uint64>(insn.r.nnn->value, 64)));
+      else
+        demand_mop(out, insn.l, bits);
+      demand_mop(out, insn.r, insn.r.size * 8);
+      break;
+    default:
+      demand_mop(out, insn.l, insn.l.size * 8);
+      demand_mop(out, insn.r, insn.r.size * 8);
+      break;
+  }
+}
+
+//-------------------------------------------------------------------------
+void get_demanded_widths(var_widths_t *out, const minsn_t &insn)
+{
+  out->clear();
+  demand_insn(out, insn, insn.d.size * 8);
+}
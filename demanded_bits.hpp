@@ -0,0 +1,34 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+//-------------------------------------------------------------------------
+// the number of low bits of each input variable that the result of an
+// expression depends on. a variable that is missing does not affect the
+// result at all.
+typedef std::map<const mop_t, int> var_widths_t;
+
+//-------------------------------------------------------------------------
+// computes the demanded bits of the variables of the instruction, going
+// down from its result. the low n bits of a sum, a product, or a bitwise
+// operation depend only on the low n bits of its operands, so e.g. in
+// low.1(x.4 * 3 + y.4) only the low 8 bits of x and y matter. the
+// operations whose low bits depend on the high bits of their operands,
+// like the right shifts and the comparisons, demand all the bits.
+// the other bits of the variables may be fixed to zero when the expression
+// is verified, which gives much smaller formulas and input spaces.
+void get_demanded_widths(var_widths_t *out, const minsn_t &insn);
+
+//-------------------------------------------------------------------------
+inline int get_demanded_width(const var_widths_t &widths, const mop_t &var)
+{
+  auto p = widths.find(var);
+  return p != widths.end() ? p->second : 0;
+}
@@ -53,6 +53,50 @@ minsn_t *make_concrete_minsn(ea_t ea, const minsn_t &minsn, const mopvec_t &new_
   return res;
 }
 
+//-------------------------------------------------------------------------
+// the reverse of make_concrete_minsn: replaces all references to the input
+// variables with abstract mop_l's whose index is the position in 'vars'.
+// the destination operand is dropped, only its size is kept.
+// returns nullptr if the instruction refers to a variable not in 'vars'.
+minsn_t *make_abstract_minsn(const minsn_t &minsn, const mopvec_t &vars)
+{
+  struct mop_abstractor_t : public mop_visitor_t
+  {
+    const mopvec_t &vars;
+    mop_abstractor_t(const mopvec_t &v) : vars(v) {}
+    int idaapi visit_mop(mop_t *op, const tinfo_t *, bool)
+    {
+      mopt_t t = op->t;
+      if ( t == mop_r || t == mop_S || t == mop_v || t == mop_l )
+      {
+        auto p = std::find(vars.begin(), vars.end(), *op);
+        if ( p == vars.end() )
+          return -1;
+        int size = op->size;
+        op->erase();
+        op->t = mop_l;
+        op->l = new lvar_ref_t(nullptr, p - vars.begin());
+        op->size = size;
+      }
+      return 0;
+    }
+  };
+
+  minsn_t *copy = new minsn_t(minsn);
+  int dsz = copy->d.size;
+  copy->d.erase();
+  copy->d.size = dsz;
+
+  mop_abstractor_t ma(vars);
+  if ( copy->for_all_ops(ma) < 0 )
+  {
+    delete copy;
+    return nullptr;
+  }
+  copy->setaddr(0);
+  return copy;
+}
+
 //-------------------------------------------------------------------------
 static void create_var_mapping(var_mapping_t &dest, const mopvec_t &mops)
 {
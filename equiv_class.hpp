@@ -25,6 +25,12 @@ typedef std::map<func_fingerprint_t, minsn_set_t> equiv_class_map_t;
 
 #define CHECK_SERIALIZATION_CONSISTENCY true
 
+//-------------------------------------------------------------------------
+// an *abstract* minsn refers to its input variables through mop_l's whose
+// index is the position of the variable in a list of input mops
+minsn_t *make_concrete_minsn(ea_t ea, const minsn_t &minsn, const mopvec_t &new_vars, int newsz);
+minsn_t *make_abstract_minsn(const minsn_t &minsn, const mopvec_t &vars);
+
 //-------------------------------------------------------------------------
 // output behavior is summarized as a list of uint64's, each corresponding to a test case
 inline func_fingerprint_t compute_fingerprint_from_outputs(const output_behavior_t &outputs)
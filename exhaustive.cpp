@@ -0,0 +1,349 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "exhaustive.hpp"
+#include "heuristics.hpp"
+
+//-------------------------------------------------------------------------
+// 'sbits' is 64 minus the number of bits of the value
+inline int64 sext(uint64 v, int sbits)
+{
+  return int64(v << sbits) >> sbits;
+}
+
+//-------------------------------------------------------------------------
+int batch_program_t::add_mop(const mop_t &op, const layout_t &layout)
+{
+  if ( op.size < 1 || op.size > 8 )
+    return -1;
+  step_t s;
+  s.size = op.size;
+  s.opsize = op.size;
+  switch ( op.t )
+  {
+    case mop_n:
+      s.opcode = m_ldc;
+      s.value = op.nnn->value & make_mask<uint64>(op.size * 8);
+      break;
+    case mop_d:
+      return add_insn(*op.d, layout);
+    case mop_r:
+    case mop_S:
+    case mop_v:
+    case mop_l:
+      {
+        const mop_t *p = std::find(layout.vars.begin(), layout.vars.end(), op);
+        if ( p == layout.vars.end() )
+          return -1;
+        size_t idx = p - layout.vars.begin();
+        s.opcode = m_nop;
+        s.value = make_mask<uint64>(layout.widths[idx]);
+        s.shift = layout.shifts[idx];
+      }
+      break;
+    default:
+      return -1;
+  }
+  steps.push_back(s);
+  return steps.size() - 1;
+}
+
+//-------------------------------------------------------------------------
+int batch_program_t::add_insn(const minsn_t &insn, const layout_t &layout)
+{
+  if ( insn.is_fpinsn() || insn.d.size < 1 || insn.d.size > 8 )
+    return -1;
+  bool binary;
+  switch ( insn.opcode )
+  {
+    case m_ldc:
+    case m_mov:
+      return add_mop(insn.l, layout);
+    case m_neg:
+    case m_lnot:
+    case m_bnot:
+    case m_xds:
+    case m_xdu:
+    case m_low:
+    case m_high:
+    case m_sets:
+      binary = false;
+      break;
+    case m_shl:
+    case m_shr:
+    case m_sar:
+      // the shift count may be smaller than the shifted value
+      binary = true;
+      break;
+    case m_add:
+    case m_sub:
+    case m_mul:
+    case m_or:
+    case m_and:
+    case m_xor:
+    case m_setnz:
+    case m_setz:
+    case m_setae:
+    case m_setb:
+    case m_seta:
+    case m_setbe:
+    case m_setg:
+    case m_setge:
+    case m_setl:
+    case m_setle:
+      if ( insn.l.size != insn.r.size )
+        return -1;
+      binary = true;
+      break;
+    default:
+      return -1; // e.g. the division, whose result by zero differs from z3
+  }
+  step_t s;
+  s.opcode = insn.opcode;
+  s.size = insn.d.size;
+  s.opsize = insn.l.size;
+  s.l = add_mop(insn.l, layout);
+  if ( s.l < 0 )
+    return -1;
+  if ( binary )
+  {
+    s.r = add_mop(insn.r, layout);
+    if ( s.r < 0 )
+      return -1;
+  }
+  steps.push_back(s);
+  return steps.size() - 1;
+}
+
+//-------------------------------------------------------------------------
+bool batch_program_t::compile(
+        const minsn_t &insn,
+        const mopvec_t &vars,
+        const intvec_t &shifts,
+        const intvec_t &widths)
+{
+  steps.clear();
+  layout_t layout = { vars, shifts, widths };
+  if ( add_insn(insn, layout) < 0 )
+    return false;
+  slots.resize(steps.size() * EXH_BATCH_SIZE);
+  // the constants are the same for all the batches
+  for ( size_t k = 0; k < steps.size(); k++ )
+    if ( steps[k].opcode == m_ldc )
+      std::fill_n(&slots[k * EXH_BATCH_SIZE], EXH_BATCH_SIZE, steps[k].value);
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// the results are truncated to the size of the step, the same way as in
+// z3_converter_t. the operands are sign extended for the signed operations.
+const uint64 *batch_program_t::run(uint64 base)
+{
+  const int N = EXH_BATCH_SIZE;
+  for ( size_t k = 0; k < steps.size(); k++ )
+  {
+    const step_t &s = steps[k];
+    uint64 *d = &slots[k * N];
+    const uint64 *a = s.l >= 0 ? &slots[s.l * N] : nullptr;
+    const uint64 *b = s.r >= 0 ? &slots[s.r * N] : nullptr;
+    const uint64 m = make_mask<uint64>(s.size * 8);
+    const uint64 bits = s.size * 8;
+    const int sbits = 64 - s.opsize * 8;
+    switch ( s.opcode )
+    {
+      case m_nop:
+        for ( int i = 0; i < N; i++ )
+          d[i] = ((base + i) >> s.shift) & s.value;
+        break;
+      case m_ldc:
+        break;
+      case m_neg:
+        for ( int i = 0; i < N; i++ )
+          d[i] = (0 - a[i]) & m;
+        break;
+      case m_lnot:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] == 0;
+        break;
+      case m_bnot:
+        for ( int i = 0; i < N; i++ )
+          d[i] = ~a[i] & m;
+        break;
+      case m_xds:
+        for ( int i = 0; i < N; i++ )
+          d[i] = uint64(sext(a[i], sbits)) & m;
+        break;
+      case m_xdu:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i];
+        break;
+      case m_low:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] & m;
+        break;
+      case m_high:
+        for ( int i = 0; i < N; i++ )
+          d[i] = (a[i] >> ((s.opsize - s.size) * 8)) & m;
+        break;
+      case m_add:
+        for ( int i = 0; i < N; i++ )
+          d[i] = (a[i] + b[i]) & m;
+        break;
+      case m_sub:
+        for ( int i = 0; i < N; i++ )
+          d[i] = (a[i] - b[i]) & m;
+        break;
+      case m_mul:
+        for ( int i = 0; i < N; i++ )
+          d[i] = (a[i] * b[i]) & m;
+        break;
+      case m_or:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] | b[i];
+        break;
+      case m_and:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] & b[i];
+        break;
+      case m_xor:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] ^ b[i];
+        break;
+      case m_shl:
+        for ( int i = 0; i < N; i++ )
+          d[i] = b[i] >= bits ? 0 : (a[i] << b[i]) & m;
+        break;
+      case m_shr:
+        for ( int i = 0; i < N; i++ )
+          d[i] = b[i] >= bits ? 0 : a[i] >> b[i];
+        break;
+      case m_sar:
+        for ( int i = 0; i < N; i++ )
+          d[i] = uint64(sext(a[i], sbits) >> (b[i] >= bits ? bits - 1 : b[i])) & m;
+        break;
+      case m_sets:
+        for ( int i = 0; i < N; i++ )
+          d[i] = sext(a[i], sbits) < 0;
+        break;
+      case m_setnz:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] != b[i];
+        break;
+      case m_setz:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] == b[i];
+        break;
+      case m_setae:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] >= b[i];
+        break;
+      case m_setb:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] < b[i];
+        break;
+      case m_seta:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] > b[i];
+        break;
+      case m_setbe:
+        for ( int i = 0; i < N; i++ )
+          d[i] = a[i] <= b[i];
+        break;
+      case m_setg:
+        for ( int i = 0; i < N; i++ )
+          d[i] = sext(a[i], sbits) > sext(b[i], sbits);
+        break;
+      case m_setge:
+        for ( int i = 0; i < N; i++ )
+          d[i] = sext(a[i], sbits) >= sext(b[i], sbits);
+        break;
+      case m_setl:
+        for ( int i = 0; i < N; i++ )
+          d[i] = sext(a[i], sbits) < sext(b[i], sbits);
+        break;
+      case m_setle:
+        for ( int i = 0; i < N; i++ )
+          d[i] = sext(a[i], sbits) <= sext(b[i], sbits);
+        break;
+      default:
+        INTERR(30829); // rejected by add_insn()
+    }
+  }
+  return &slots[(steps.size() - 1) * N];
+}
+
+//-------------------------------------------------------------------------
+exhaustive_verifier_t::exhaustive_verifier_t(const minsn_t &_orig, int _max_bits)
+  : orig(_orig), max_bits(_max_bits)
+{
+  vars = get_input_mops(orig);
+  // al and eax are not independent variables
+  if ( have_overlapping_mops(vars) )
+    return;
+  get_demanded_widths(&orig_widths, orig);
+  occurrences = get_input_mops_by_occurrence(orig);
+  ok = true;
+}
+
+//-------------------------------------------------------------------------
+native_verdict_t exhaustive_verifier_t::verify(const minsn_t &cand, cex_t *cex)
+{
+  if ( !ok )
+    return NV_UNKNOWN;
+
+  // the bits that neither expression demands are left 0
+  var_widths_t cand_widths;
+  get_demanded_widths(&cand_widths, cand);
+  intvec_t shifts;
+  intvec_t widths;
+  int nbits = 0;
+  for ( const mop_t &var : vars )
+  {
+    int width = qmax(get_demanded_width(orig_widths, var), get_demanded_width(cand_widths, var));
+    shifts.push_back(nbits);
+    widths.push_back(width);
+    nbits += width;
+  }
+  if ( nbits > max_bits )
+    return NV_UNKNOWN;
+
+  batch_program_t orig_prog;
+  batch_program_t cand_prog;
+  if ( !orig_prog.compile(orig, vars, shifts, widths)
+    || !cand_prog.compile(cand, vars, shifts, widths)
+    || cand_prog.result_size() != orig_prog.result_size() )
+  {
+    return NV_UNKNOWN;
+  }
+
+  uint64 ninputs = uint64(1) << nbits;
+  for ( uint64 base = 0; base < ninputs; base += EXH_BATCH_SIZE )
+  {
+    const uint64 *o = orig_prog.run(base);
+    const uint64 *c = cand_prog.run(base);
+    for ( int i = 0; i < EXH_BATCH_SIZE && base + i < ninputs; i++ )
+    {
+      if ( o[i] == c[i] )
+        continue;
+      cex->clear();
+      for ( const mop_t &op : occurrences )
+      {
+        const mop_t *p = std::find(vars.begin(), vars.end(), op);
+        uint64 v = 0;
+        if ( p != vars.end() )
+        {
+          size_t idx = p - vars.begin();
+          v = ((base + i) >> shifts[idx]) & make_mask<uint64>(widths[idx]);
+        }
+        cex->push_back(v);
+      }
+      return NV_DIFFERENT;
+    }
+  }
+  return NV_EQUIVALENT;
+}
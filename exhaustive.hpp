@@ -0,0 +1,85 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+#include "lin_verify.hpp"
+#include "demanded_bits.hpp"
+
+// the expressions are evaluated on this many inputs at a time
+const int EXH_BATCH_SIZE = 256;
+// the default of MBA_EXHAUSTIVE_BITS: 2^20 inputs take a few milliseconds
+const int EXH_DEFAULT_INPUT_BITS = 20;
+// the limit of MBA_EXHAUSTIVE_BITS: the enumeration runs on the main thread
+// and does not look at the deadline, so it must stay short
+const int EXH_MAX_INPUT_BITS = 24;
+
+//-------------------------------------------------------------------------
+// an expression compiled for the evaluation on a batch of inputs. each step
+// computes one subexpression for all the inputs of the batch in a simple
+// loop, which the compiler turns into SIMD instructions.
+class batch_program_t
+{
+  struct step_t
+  {
+    mcode_t opcode;   // m_ldc for the constants, m_nop for the variables
+    int size;         // of the result, in bytes
+    int opsize;       // of the left operand, in bytes
+    int l = -1;       // the steps that compute the operands
+    int r = -1;
+    uint64 value = 0; // m_ldc: the constant. m_nop: the mask of the variable
+    int shift = 0;    // m_nop: the position of the variable in the input index
+  };
+  // where the variables are taken from the input index
+  struct layout_t
+  {
+    const mopvec_t &vars;
+    const intvec_t &shifts;   // the position of the bits of each variable
+    const intvec_t &widths;   // and their number, the other bits are 0
+  };
+  qvector<step_t> steps;
+  qvector<uint64> slots; // the results of the steps, EXH_BATCH_SIZE each
+
+  int add_mop(const mop_t &op, const layout_t &layout);
+  int add_insn(const minsn_t &insn, const layout_t &layout);
+
+public:
+  // returns false if the expression uses an unsupported operation or a
+  // variable that is not in 'vars'. the low widths[n] bits of the nth
+  // variable are taken from the input index at shifts[n].
+  bool compile(
+        const minsn_t &insn,
+        const mopvec_t &vars,
+        const intvec_t &shifts,
+        const intvec_t &widths);
+  int result_size() const { return steps.back().size; }
+  // evaluates the inputs [base, base + EXH_BATCH_SIZE)
+  const uint64 *run(uint64 base);
+};
+
+//-------------------------------------------------------------------------
+// the proof by enumeration of all the inputs, for expressions whose
+// variables have a few bits in total, e.g. two 8-bit ones. unlike the
+// truth tables of linear_verifier_t, this works for any expression, and is
+// faster than the bit-blasting of z3 for such small input spaces.
+// only the demanded bits of the variables are enumerated (see
+// demanded_bits.hpp), so low.1(x.4 + y.4) has 16 bits of inputs, not 64.
+class exhaustive_verifier_t
+{
+  minsn_t orig;
+  mopvec_t vars;          // the variables of the original
+  mopvec_t occurrences;   // the same, in the order of the counterexamples
+  var_widths_t orig_widths; // their demanded bits
+  int max_bits;
+  bool ok = false;
+
+public:
+  exhaustive_verifier_t(const minsn_t &_orig, int _max_bits);
+  // the inputs of an NV_DIFFERENT verdict are returned in 'cex'
+  native_verdict_t verify(const minsn_t &cand, cex_t *cex);
+};
@@ -14,6 +14,9 @@
 #include "optimizer.hpp"
 #include "equiv_class.hpp"
 #include "file.hpp"
+#include "background.hpp"
+#include "batch.hpp"
+#include "dag.hpp"
 #include <hexrays.hpp>
 #include <err.h>
 
@@ -43,21 +46,61 @@ struct run_ah_t : public action_handler_t
   };
 };
 
+//--------------------------------------------------------------------------
+// simplifies the instructions as soon as the decompiler optimizes them,
+// an alternative to the glbopt pass
+struct mba_optinsn_t : public optinsn_t
+{
+  plugin_ctx_t *plugmod;
+
+  mba_optinsn_t(plugin_ctx_t *_plugmod) : plugmod(_plugmod) {}
+  virtual int idaapi func(mblock_t *blk, minsn_t *ins, int optflags) override;
+};
+
+struct mba_insn_t;
+
 //--------------------------------------------------------------------------
 //lint -e{958} padding of 7 bytes needed to align member on a 8 byte boundary
 struct plugin_ctx_t : public plugmod_t
 {
   bool run_automatically = false;
   qstring oracle_path;
+  qstring shared_store_path;
+  qstring portfolio_spec;
 
   run_ah_t run_ah;
+  mba_optinsn_t optinsn;
+  bool use_optinsn = false;
+  bool early_pass = false;
+  bool combine_insns = true;
   optimizer_t optimizer;
+  background_simplifier_t background;
+  batch_t batch;
   bool plugmod_active = false;
+  bool user_activated = false;    // the next decompilation was requested from the menu
   bool inited_oracle = false;
+  bool inited_shared_store = false;
+  int density_threshold = 3;
+  std::map<ea_t, int> densities;  // function entry -> count_mixed_opc_pairs()
+  const mba_t *started_mba = nullptr; // the optimizer was started for this mba
+  int nimproved = 0;    // expressions improved in the current decompilation
+  std::chrono::high_resolution_clock::time_point decompile_start;
   plugin_ctx_t();
-  ~plugin_ctx_t() { term_hexrays_plugin(); }
+  ~plugin_ctx_t()
+  {
+    if ( use_optinsn )
+      optinsn.remove();
+    term_hexrays_plugin();
+  }
   virtual bool idaapi run(size_t) override;
   void init_oracle();
+  void init_shared_store();
+  bool is_dense(mba_t *mba);
+  void start_optimizer(mba_t *mba);
+  void finish_optimizer();
+  int run_pass(mba_t *mba);
+  bool optimize_top_insn(mblock_t *blk, minsn_t *insn);
+  int optimize_top_insns(const qvector<mba_insn_t> &insns);
 };
 
 //--------------------------------------------------------------------------
@@ -96,6 +139,88 @@ void plugin_ctx_t::init_oracle()
   }
 }
 
+//--------------------------------------------------------------------------
+void plugin_ctx_t::init_shared_store()
+{
+  if ( inited_shared_store )
+    return;
+  inited_shared_store = true;
+
+  if ( shared_store_path.empty() )
+    qgetenv("VD_MBA_SHARED_STORE_PATH", &shared_store_path);
+
+  if ( !shared_store_path.empty() )
+  {
+    const char *path = shared_store_path.c_str();
+    if ( optimizer.shared_store.open(path) )
+      msg("%s: loaded %" FMT_Z " shared MBA simplifications for goomba\n",
+          path, optimizer.shared_store.size());
+  }
+}
+
+//--------------------------------------------------------------------------
+void plugin_ctx_t::start_optimizer(mba_t *mba)
+{
+  // read the oracle and shared store files if not done yet
+  init_oracle();
+  init_shared_store();
+  // a background decompilation blocks the user interface and no events
+  // are processed meanwhile, so it gets a very short budget
+  optimizer.start(mba, background.decompiling ? BG_FUNC_TIME_BUDGET : 0);
+  started_mba = mba;
+}
+
+//--------------------------------------------------------------------------
+void plugin_ctx_t::finish_optimizer()
+{
+  optimizer.store.save();
+  optimizer.cex_store.save();
+  optimizer.cache.print_templates();
+  if ( qgetenv("VD_MBA_LOG_PERF") )
+    optimizer.print_engine_stats();
+  if ( nimproved != 0 )
+    msg("goomba: completed mba optimization pass, improved %d expressions (%d cache hits, %d shared)\n",
+        nimproved, optimizer.cache.nhits, optimizer.shared_store.nhits);
+  batch.nimproved += nimproved;
+  nimproved = 0;
+  started_mba = nullptr;
+}
+
+//--------------------------------------------------------------------------
+int idaapi mba_optinsn_t::func(mblock_t *blk, minsn_t *ins, int)
+{
+  if ( !plugmod->plugmod_active )
+    return 0;
+  mba_t *mba = blk->mba;
+  if ( mba->maturity < (plugmod->early_pass ? MMAT_LOCOPT : MMAT_GLBOPT1) )
+    return 0; // wait until the expressions are propagated
+
+  optimizer_t &optimizer = plugmod->optimizer;
+  if ( plugmod->started_mba != mba )
+  {
+    plugmod->start_optimizer(mba);
+    optimizer.cancellable = false; // no wait box around single instructions
+  }
+  if ( optimizer.should_stop() || !plugmod->optimize_top_insn(blk, ins) )
+    return 0;
+
+  plugmod->nimproved++;
+  blk->mark_lists_dirty();
+  return 1;
+}
+
+//--------------------------------------------------------------------------
+// decides whether the function is worth optimizing in automatic mode
+bool plugin_ctx_t::is_dense(mba_t *mba)
+{
+  if ( density_threshold == 0 )
+    return true;
+  auto p = densities.find(mba->entry_ea);
+  if ( p == densities.end() )
+    p = densities.insert({ mba->entry_ea, count_mixed_opc_pairs(mba) }).first;
+  return p->second >= density_threshold;
+}
+
 //--------------------------------------------------------------------------
 static plugmod_t *idaapi init()
 {
@@ -113,10 +238,37 @@ static plugmod_t *idaapi init()
     cfgopt_t("MBA_RUN_AUTOMATICALLY", &plugmod->run_automatically, 1),
     cfgopt_t("MBA_Z3_TIMEOUT", &plugmod->optimizer.z3_timeout),
     cfgopt_t("MBA_ORACLE_PATH", &plugmod->oracle_path),
-    cfgopt_t("MBA_Z3_ASSUME_TIMEOUTS_CORRECT", &plugmod->optimizer.z3_assume_timeouts_correct, 1)
+    cfgopt_t("MBA_Z3_ASSUME_TIMEOUTS_CORRECT", &plugmod->optimizer.z3_assume_timeouts_correct, 1),
+    cfgopt_t("MBA_Z3_PATH", &plugmod->optimizer.processes.path),
+    cfgopt_t("MBA_SMT_CAPTURE_DIR", &plugmod->optimizer.capture_dir),
+    cfgopt_t("MBA_FUNC_TIME_BUDGET", &plugmod->optimizer.func_time_budget),
+    cfgopt_t("MBA_THREADS", &plugmod->optimizer.nthreads, 0, 256),
+    cfgopt_t("MBA_PORTFOLIO", &plugmod->portfolio_spec),
+    cfgopt_t("MBA_PORTFOLIO_SIZE", &plugmod->optimizer.portfolio_size, 0, 64),
+    cfgopt_t("MBA_EXHAUSTIVE_BITS", &plugmod->optimizer.exhaustive_bits, 0, EXH_MAX_INPUT_BITS),
+    cfgopt_t("MBA_DENSITY_THRESHOLD", &plugmod->density_threshold, 0, 1000),
+    cfgopt_t("MBA_USE_OPTINSN", &plugmod->use_optinsn, 1),
+    cfgopt_t("MBA_EARLY_PASS", &plugmod->early_pass, 1),
+    cfgopt_t("MBA_COMBINE_INSNS", &plugmod->combine_insns, 1),
+    cfgopt_t("MBA_STORE_RESULTS", &plugmod->optimizer.store.enabled, 1),
+    cfgopt_t("MBA_STORE_COUNTEREXAMPLES", &plugmod->optimizer.cex_store.enabled, 1),
+    cfgopt_t("MBA_SHARED_STORE_PATH", &plugmod->shared_store_path),
+    cfgopt_t("MBA_BACKGROUND", &plugmod->background.enabled, 1),
+    cfgopt_t("MBA_BACKGROUND_LOAD", &plugmod->background.load, 1, 100),
+    cfgopt_t("MBA_BACKGROUND_IDLE_DELAY", &plugmod->background.idle_delay, 0, 3600),
   };
 
   read_config_file("goomba", cfgopts, qnumber(cfgopts), nullptr);
+  qstring errbuf;
+  if ( !parse_smt_strategies(&plugmod->optimizer.portfolio, plugmod->portfolio_spec.c_str(), &errbuf) )
+    msg("goomba: MBA_PORTFOLIO: %s\n", errbuf.c_str());
+  // they change which instructions are optimized and at which maturity,
+  // so the stored results depend on them
+  plugmod->optimizer.pass_settings = (uint64(plugmod->combine_insns) << 2)
+                                   | (uint64(plugmod->use_optinsn) << 1)
+                                   | plugmod->early_pass;
+  if ( plugmod->use_optinsn )
+    plugmod->optinsn.install();
 
   qstring ifpath;
   if ( qgetenv("VD_MSYNTH_PATH", &ifpath) )
@@ -155,6 +307,73 @@ static plugmod_t *idaapi init()
     qexit(0);
   }
 
+  // merge another shared store into ours, or write a compacted copy of ours
+  qstring import_path;
+  qstring export_path;
+  bool do_import = qgetenv("VD_MBA_SHARED_STORE_IMPORT", &import_path);
+  bool do_export = qgetenv("VD_MBA_SHARED_STORE_EXPORT", &export_path);
+  if ( do_import || do_export )
+  {
+    plugmod->init_shared_store();
+    if ( !plugmod->optimizer.shared_store.is_open() )
+      error("goomba: shared store is not configured, set MBA_SHARED_STORE_PATH");
+    if ( do_import )
+    {
+      int n = plugmod->optimizer.shared_store.import_file(import_path.c_str());
+      if ( n < 0 )
+        error("%s: failed to import", import_path.c_str());
+      msg("%s: imported %d simplifications\n", import_path.c_str(), n);
+    }
+    if ( do_export )
+    {
+      int n = plugmod->optimizer.shared_store.export_file(export_path.c_str());
+      if ( n < 0 )
+        error("%s: failed to export", export_path.c_str());
+      msg("%s: exported %d simplifications\n", export_path.c_str(), n);
+    }
+    // do not save the IDB
+    set_database_flag(DBFL_KILL);
+    qexit(0);
+  }
+
+  // decompile the whole database with a pool of worker processes
+  qstring batch_spec;
+  if ( qgetenv("VD_MBA_BATCH_WORKER", &batch_spec) )
+  {
+    qstring report_path;
+    int index;
+    int nworkers;
+    if ( !qgetenv("VD_MBA_BATCH_REPORT", &report_path)
+      || qsscanf(batch_spec.c_str(), "%d/%d", &index, &nworkers) != 2
+      || index < 0 || index >= nworkers )
+    {
+      error("goomba: bad batch worker specification: %s", batch_spec.c_str());
+    }
+    bool ok = plugmod->batch.run_worker(index, nworkers, report_path.c_str());
+    set_database_flag(DBFL_KILL);
+    qexit(ok ? 0 : 1);
+  }
+  if ( qgetenv("VD_MBA_BATCH_WORKERS", &batch_spec) )
+  {
+    qstring report_path;
+    if ( !qgetenv("VD_MBA_BATCH_REPORT", &report_path) )
+      error("goomba: VD_MBA_BATCH_REPORT is not set");
+    int nworkers = atoi(batch_spec.c_str());
+    if ( nworkers <= 0 )
+      error("goomba: bad number of batch workers: %s", batch_spec.c_str());
+    bool ok = plugmod->batch.run_coordinator(nworkers, report_path.c_str());
+    set_database_flag(DBFL_KILL);
+    qexit(ok ? 0 : 1);
+  }
+
+  if ( plugmod->background.enabled )
+  {
+    if ( plugmod->optimizer.store.enabled )
+      plugmod->background.start(plugmod);
+    else
+      msg("goomba: background simplification requires MBA_STORE_RESULTS, disabled\n");
+  }
+
   return plugmod;
 }
 
@@ -164,7 +383,7 @@ int idaapi run_ah_t::activate(action_activation_ctx_t *ctx)
   vdui_t *vu = get_widget_vdui(ctx->widget);
   if ( vu != nullptr )
   {
-    plugmod->plugmod_active = true;
+    plugmod->user_activated = true;
     vu->refresh_view(true);
     return 1;
   }
@@ -301,6 +520,193 @@ static void find_and_print_overlapped_operands(mba_t *mba)
 #endif
 }
 
+//--------------------------------------------------------------------------
+// a top-level instruction to optimize
+struct mba_insn_t
+{
+  mblock_t *blk;
+  minsn_t *insn;
+  int score;      // complexity of the instruction, the expected payoff
+};
+
+//--------------------------------------------------------------------------
+// optimizes a top-level instruction of the block. if the expression is split
+// over several instructions, the combined expression is tried first.
+bool plugin_ctx_t::optimize_top_insn(mblock_t *blk, minsn_t *insn)
+{
+  minsn_t *dag = combine_insns ? build_insn_dag(blk, *insn) : nullptr;
+  if ( dag != nullptr )
+  {
+    // the combined expression replaces the instruction only if it got
+    // simpler than the instruction itself, otherwise the definitions
+    // would be duplicated
+    if ( optimizer.optimize_insn(dag)
+      && score_complexity(*dag) < score_complexity(*insn) )
+    {
+      substitute(insn, dag);
+      delete dag;
+      return true;
+    }
+    delete dag;
+    if ( optimizer.should_stop() )
+      return false;
+  }
+  return optimizer.optimize_insn_recurse(insn);
+}
+
+//--------------------------------------------------------------------------
+// the same as optimize_top_insn() for all instructions, in stages whose
+// proofs run in parallel: the combined expressions, then the instructions
+// themselves, then their subinstructions, level by level.
+// returns the number of simplified instructions.
+int plugin_ctx_t::optimize_top_insns(const qvector<mba_insn_t> &insns)
+{
+  size_t n = insns.size();
+  boolvec_t done;
+  done.resize(n);
+  std::fill(done.begin(), done.end(), false);
+  minsnptrs_t targets;
+  sizevec_t owners;     // indexes of the top-level instructions of the targets
+  boolvec_t res;
+
+  if ( combine_insns )
+  {
+    minsnptrs_t dags;
+    for ( size_t i = 0; i < n; i++ )
+    {
+      minsn_t *dag = build_insn_dag(insns[i].blk, *insns[i].insn);
+      if ( dag != nullptr )
+      {
+        dags.push_back(dag);
+        owners.push_back(i);
+      }
+    }
+    optimizer.optimize_insns(&res, dags);
+    for ( size_t k = 0; k < dags.size(); k++ )
+    {
+      minsn_t *insn = insns[owners[k]].insn;
+      if ( res[k] && score_complexity(*dags[k]) < score_complexity(*insn) )
+      {
+        substitute(insn, dags[k]);
+        done[owners[k]] = true;
+      }
+      delete dags[k];
+    }
+    owners.clear();
+  }
+
+  for ( size_t i = 0; i < n; i++ )
+  {
+    if ( !done[i] )
+    {
+      targets.push_back(insns[i].insn);
+      owners.push_back(i);
+    }
+  }
+  boolvec_t simplified;
+  simplified.resize(n);
+  std::fill(simplified.begin(), simplified.end(), false);
+  // collects the subinstructions of an instruction, like the visitor of
+  // optimizer_t::optimize_insn_recurse(), but only those of the next level:
+  // the deeper ones are the stages that follow
+  struct ida_local subinsn_collector_t : public mop_visitor_t
+  {
+    minsnptrs_t *subinsns;
+    subinsn_collector_t(minsnptrs_t *s) : subinsns(s) {}
+    int idaapi visit_mop(mop_t *op, const tinfo_t *, bool) override
+    {
+      prune = op->is_insn();
+      if ( prune )
+        subinsns->push_back(op->d);
+      return 0;
+    }
+  };
+  while ( !targets.empty() && !optimizer.should_stop() )
+  {
+    optimizer.optimize_insns(&res, targets);
+    // the subinstructions of the failed targets are the next stage.
+    // the simplified targets are not visited: their subinstructions
+    // were replaced.
+    minsnptrs_t subinsns;
+    sizevec_t subowners;
+    subinsn_collector_t collector(&subinsns);
+    for ( size_t k = 0; k < targets.size(); k++ )
+    {
+      if ( res[k] )
+      {
+        simplified[owners[k]] = true;
+        continue;
+      }
+      targets[k]->for_all_ops(collector);
+      subowners.resize(subinsns.size(), owners[k]);
+    }
+    targets.swap(subinsns);
+    owners.swap(subowners);
+  }
+
+  int cnt = 0;
+  for ( size_t i = 0; i < n; i++ )
+  {
+    if ( done[i] || simplified[i] )
+    {
+      cnt++;
+      insns[i].blk->mark_lists_dirty();
+      insns[i].blk->mba->dump_mba(true, "vd_mba success %a", insns[i].insn->ea);
+    }
+  }
+  return cnt;
+}
+
+//--------------------------------------------------------------------------
+// optimizes the top-level instructions of the mba, returns the number of
+// simplified instructions
+int plugin_ctx_t::run_pass(mba_t *mba)
+{
+  // collect the instructions first and start with the most complex
+  // ones: they are the most likely to pay off if the time runs out
+  struct ida_local insn_collector_t : public minsn_visitor_t
+  {
+    qvector<mba_insn_t> insns;
+    int idaapi visit_minsn() override
+    {
+      insns.push_back({ blk, curins, score_complexity(*curins) });
+      return 0;
+    }
+  };
+  insn_collector_t collector;
+  mba->for_all_topinsns(collector);
+  qvector<mba_insn_t> &insns = collector.insns;
+  std::stable_sort(insns.begin(), insns.end(),
+                   [](const mba_insn_t &a, const mba_insn_t &b) { return a.score > b.score; });
+
+  // there is no one to press cancel in the background or batch modes
+  optimizer.cancellable = !background.decompiling && !batch.worker;
+  if ( optimizer.cancellable )
+    show_wait_box("goomba: simplifying MBA expressions");
+  int cnt = 0;
+  size_t i = 0;
+  if ( optimizer.get_nthreads() > 1 )
+  {
+    cnt = optimize_top_insns(insns);
+    i = insns.size();
+  }
+  for ( ; i < insns.size() && !optimizer.should_stop(); i++ )
+  {
+    const mba_insn_t &mi = insns[i];
+    if ( optimize_top_insn(mi.blk, mi.insn) )
+    {
+      cnt++;
+      mi.blk->mark_lists_dirty();
+      mba->dump_mba(true, "vd_mba success %a", mi.insn->ea);
+    }
+  }
+  if ( optimizer.cancellable )
+    hide_wait_box();
+  if ( i < insns.size() )
+    msg("goomba: %" FMT_Z " instructions were not processed\n", insns.size() - i);
+  return cnt;
+}
+
 //--------------------------------------------------------------------------
 // This callback handles various hexrays events.
 static ssize_t idaapi callback(void *ud, hexrays_event_t event, va_list va)
@@ -311,7 +717,24 @@ static ssize_t idaapi callback(void *ud, hexrays_event_t event, va_list va)
     case hxe_microcode: // microcode has been generated
       {
         mba_t *mba = va_arg(va, mba_t *);
-        if ( always_on() || plugmod->run_automatically )
+        // the previous decompilation failed or was cancelled before the
+        // optimizer was finished: save what it found
+        if ( plugmod->started_mba != nullptr )
+          plugmod->finish_optimizer();
+        // a new microcode object: results of the previous function are useless
+        plugmod->optimizer.cache.reset(mba);
+        plugmod->optimizer.shared_store.nhits = 0;
+        plugmod->nimproved = 0;
+        plugmod->decompile_start = std::chrono::high_resolution_clock::now();
+        // the activation by the user applies to this decompilation only
+        plugmod->plugmod_active = plugmod->user_activated || always_on();
+        plugmod->user_activated = false;
+        // in automatic mode, skip the functions that do not look obfuscated.
+        // when activated by the user, the optimizer is always run.
+        bool automatic = plugmod->run_automatically
+                      || plugmod->background.decompiling
+                      || plugmod->batch.worker;
+        if ( automatic && !plugmod->plugmod_active && plugmod->is_dense(mba) )
           plugmod->plugmod_active = true;
         if ( plugmod->plugmod_active )
           mba->set_mba_flags2(MBA2_PROP_COMPLEX); // increase acceptable complexity
@@ -326,50 +749,66 @@ static ssize_t idaapi callback(void *ud, hexrays_event_t event, va_list va)
       }
       break;
 
+    case hxe_locopt: // the expressions are assembled by the local propagation
+      {
+        mba_t *mba = va_arg(va, mba_t *);
+        if ( !plugmod->plugmod_active || !plugmod->early_pass || plugmod->use_optinsn )
+          break;
+        plugmod->start_optimizer(mba);
+        plugmod->nimproved += plugmod->run_pass(mba);
+      }
+      break;
+
     case hxe_glbopt:
       {
         mba_t *mba = va_arg(va, mba_t *);
 
         find_and_print_overlapped_operands(mba);
 
-        if ( !plugmod->plugmod_active )
+        if ( !plugmod->plugmod_active || plugmod->use_optinsn )
           return MERR_OK;
-        // read the oracle file if not done yet
-        plugmod->init_oracle();
-
-        struct ida_local insn_optimize_t : public minsn_visitor_t
-        {
-          optimizer_t &optimizer;
-          int cnt = 0;
-          insn_optimize_t ( optimizer_t &o ) : optimizer(o) {}
-          int idaapi visit_minsn() override
-          {
-            // msg("goomba: optimizing %s\n", curins->dstr());
-            if ( optimizer.optimize_insn_recurse(curins) )
-            {
-              cnt++;
-              blk->mark_lists_dirty();
-              mba->dump_mba(true, "vd_mba success %a", curins->ea);
-            }
-            return 0;
-          }
-        };
-
-        insn_optimize_t visitor(plugmod->optimizer);
-        mba->for_all_topinsns(visitor);
+        // after an early pass, only the expressions that appeared since then
+        // are processed, the rest is answered by the cache
+        if ( plugmod->started_mba != mba )
+          plugmod->start_optimizer(mba);
+        int cnt = plugmod->run_pass(mba);
+        plugmod->nimproved += cnt;
+        plugmod->finish_optimizer();
 
         plugmod->plugmod_active = false;
         mba->clr_mba_flags2(MBA2_PROP_COMPLEX);
-        if ( visitor.cnt != 0 )
+        if ( cnt != 0 )
         {
           mba->verify(true);
-          msg("goomba: completed mba optimization pass, improved %d expressions\n", visitor.cnt);
           return MERR_LOOP; // restart optimization
         }
         return MERR_OK;
       }
       break;
 
+    case hxe_maturity:
+      {
+        va_arg(va, cfunc_t *);
+        ctree_maturity_t new_maturity = va_argi(va, ctree_maturity_t);
+        if ( new_maturity != CMAT_FINAL )
+          break;
+        if ( plugmod->started_mba != nullptr )
+        { // the optinsn handler was at work
+          plugmod->finish_optimizer();
+          plugmod->plugmod_active = false;
+        }
+        if ( qgetenv("VD_MBA_LOG_PERF") )
+        {
+          auto end = std::chrono::high_resolution_clock::now();
+          msg("goomba: decompilation time: %" FMT_64 "d ms (%s)\n",
+              std::chrono::duration_cast<std::chrono::milliseconds>(end - plugmod->decompile_start).count(),
+              plugmod->use_optinsn
+            ? (plugmod->early_pass ? "optinsn from locopt" : "optinsn")
+            : (plugmod->early_pass ? "locopt+glbopt" : "glbopt"));
+        }
+      }
+      break;
+
     default:
       break;
   }
@@ -377,7 +816,7 @@ static ssize_t idaapi callback(void *ud, hexrays_event_t event, va_list va)
 }
 
 //--------------------------------------------------------------------------
-plugin_ctx_t::plugin_ctx_t() : run_ah(this)
+plugin_ctx_t::plugin_ctx_t() : run_ah(this), optinsn(this)
 {
   install_hexrays_callback(callback, this);
   register_action(ACTION_DESC_LITERAL_PLUGMOD(
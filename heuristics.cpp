@@ -47,40 +47,67 @@ uint8 gen_rand_byte()
   }
 }
 
+//-------------------------------------------------------------------------
+enum mba_opc_kind_t { MBA_OPC_OTHER, MBA_OPC_ARITH, MBA_OPC_BOOL };
+
+static mba_opc_kind_t get_mba_opc_kind(mcode_t opcode)
+{
+  switch ( opcode )
+  {
+    case m_neg:
+    case m_add:
+    case m_sub:
+    case m_mul:
+    case m_udiv:
+    case m_sdiv:
+    case m_umod:
+    case m_smod:
+    case m_shl:
+    case m_shr:
+      return MBA_OPC_ARITH;
+    case m_bnot:
+    case m_or:
+    case m_and:
+    case m_xor:
+    case m_sar:
+      return MBA_OPC_BOOL;
+    default:
+      return MBA_OPC_OTHER;
+  }
+}
+
+//-------------------------------------------------------------------------
+struct mba_opc_counter_t : public minsn_visitor_t
+{
+  int bool_cnt = 0;
+  int arith_cnt = 0;
+  void count(const minsn_t &insn)
+  {
+    switch ( get_mba_opc_kind(insn.opcode) )
+    {
+      case MBA_OPC_ARITH:
+        arith_cnt++;
+        break;
+      case MBA_OPC_BOOL:
+        bool_cnt++;
+        break;
+      default:
+        break;
+    }
+  }
+};
+
 //-------------------------------------------------------------------------
 // guesses whether or not the instruction is MBA
 bool is_mba(const minsn_t &insn)
 {
-  struct mba_opc_counter_t : public minsn_visitor_t
+  struct insn_opc_counter_t : public mba_opc_counter_t
   {
-    int bool_cnt = 0;
-    int arith_cnt = 0;
     int idaapi visit_minsn(void) override
     {
-      switch ( curins->opcode )
-      {
-        case m_neg:
-        case m_add:
-        case m_sub:
-        case m_mul:
-        case m_udiv:
-        case m_sdiv:
-        case m_umod:
-        case m_smod:
-        case m_shl:
-        case m_shr:
-          arith_cnt++;
-          break;
-        case m_bnot:
-        case m_or:
-        case m_and:
-        case m_xor:
-        case m_sar:
-          bool_cnt++;
-          break;
-        default:
-          return 0;
-      }
+      if ( get_mba_opc_kind(curins->opcode) == MBA_OPC_OTHER )
+        return 0;
+      count(*curins);
       return bool_cnt >= MIN_MBA_BOOL_OPS && arith_cnt >= MIN_MBA_ARITH_OPS;
     }
   };
@@ -94,10 +121,71 @@ bool is_mba(const minsn_t &insn)
   if ( insn.d.size > 8 )
     return false; // we only support 64-bit math
 
-  mba_opc_counter_t cntr;
+  insn_opc_counter_t cntr;
   return CONST_CAST(minsn_t*)(&insn)->for_all_insns(cntr) != 0;
 }
 
+//-------------------------------------------------------------------------
+// a cheap estimate of the MBA density of the microcode: the largest number
+// of pairs of boolean and arithmetic operations found in a block.
+// meant for the freshly generated microcode, where expressions are not
+// propagated yet and every operation is a separate instruction.
+int count_mixed_opc_pairs(mba_t *mba)
+{
+  struct block_opc_counter_t : public mba_opc_counter_t
+  {
+    int idaapi visit_minsn(void) override
+    {
+      count(*curins);
+      return 0;
+    }
+  };
+
+  int best = 0;
+  for ( int i = 0; i < mba->qty; i++ )
+  {
+    block_opc_counter_t cntr;
+    mba->get_mblock(i)->for_all_insns(cntr);
+    best = qmax(best, qmin(cntr.bool_cnt, cntr.arith_cnt));
+  }
+  return best;
+}
+
+//-------------------------------------------------------------------------
+// returns the depth of the instruction tree
+static int collect_mba_features(mba_features_t *f, const minsn_t &insn)
+{
+  switch ( get_mba_opc_kind(insn.opcode) )
+  {
+    case MBA_OPC_ARITH:
+      f->arith_cnt++;
+      break;
+    case MBA_OPC_BOOL:
+      f->bool_cnt++;
+      break;
+    default:
+      break;
+  }
+  if ( insn.opcode == m_mul && insn.l.t != mop_n && insn.r.t != mop_n )
+    f->nonlinear = true;
+
+  int depth = 0;
+  if ( insn.l.is_insn() )
+    depth = collect_mba_features(f, *insn.l.d);
+  if ( insn.r.is_insn() )
+    depth = qmax(depth, collect_mba_features(f, *insn.r.d));
+  return depth + 1;
+}
+
+//-------------------------------------------------------------------------
+mba_features_t get_mba_features(const minsn_t &insn)
+{
+  mba_features_t f;
+  f.depth = collect_mba_features(&f, insn);
+  f.nvars = get_input_mops_by_occurrence(insn).size();
+  return f;
+}
+
 //-------------------------------------------------------------------------
 // runs a battery of random test cases against both expressions to see if they are equivalent
 bool probably_equivalent(const minsn_t &insn, const candidate_expr_t &expr)
@@ -132,6 +220,38 @@ bool probably_equivalent(const minsn_t &a, const minsn_t &b)
   return true;
 }
 
+//-------------------------------------------------------------------------
+test_battery_t::test_battery_t(const minsn_t &insn, const cexes_t *cexes, int ntests)
+{
+  size_t ncexes = cexes != nullptr ? cexes->size() : 0;
+  emus.resize(ncexes + ntests);
+  outputs.reserve(emus.size());
+  if ( ncexes != 0 )
+  {
+    // the variables that the counterexample does not cover stay random
+    mopvec_t vars = get_input_mops_by_occurrence(insn);
+    for ( size_t i = 0; i < ncexes; i++ )
+    {
+      const cex_t &cex = (*cexes)[i];
+      for ( size_t j = 0; j < vars.size() && j < cex.size(); j++ )
+        emus[i].var_vals.assign(vars[j], cex[j]);
+    }
+  }
+  for ( mcode_emu_rand_vals_t &emu : emus )
+    outputs.push_back(emu.minsn_value(insn));
+}
+
+//-------------------------------------------------------------------------
+bool test_battery_t::passes(const minsn_t &cand)
+{
+  // the variables that the expression does not use get their random
+  // values here, and keep them for the next candidates
+  for ( size_t i = 0; i < emus.size(); i++ )
+    if ( emus[i].minsn_value(cand) != outputs[i] )
+      return false;
+  return true;
+}
+
 //-------------------------------------------------------------------------
 // estimates the "complexity" of a given instruction
 int score_complexity(const minsn_t &insn)
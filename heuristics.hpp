@@ -8,6 +8,7 @@
 
 #pragma once
 #include "linear_exprs.hpp"
+#include "cex_store.hpp"
 
 const uint64 SPECIAL[] = { 0, 1, 0xffffffffffffffff };
 const uint8 SPECIAL8[] = { 0, 1, 0xff };
@@ -79,6 +80,38 @@ struct byte_val_map_t
     return bv2mcode_val(bytes);
   }
 
+  //-------------------------------------------------------------------------
+  // sets the bytes of the variable, e.g. to replay a counterexample
+  void assign(const mop_t &op, uint64 val)
+  {
+    std::map<const uval_t, uint8> *map;
+    uval_t off;
+    switch ( op.t )
+    {
+      case mop_S:         // stack variable
+        map = &stk_map;
+        off = op.s->off;
+        break;
+      case mop_v:         // global variable
+        map = &glb_map;
+        off = op.g;
+        break;
+      case mop_l:         // local variable
+        map = &local_map;
+        off = op.l->off;
+        break;
+      case mop_r:         // register
+        map = &reg_map;
+        off = op.r;
+        break;
+      default:
+        return;
+    }
+    for ( int i = 0; i < op.size; i++ )
+      (*map)[off + i] = uint8(val >> (8 * i));
+    cache.clear();
+  }
+
   //-------------------------------------------------------------------------
   intval64_t lookup(const mop_t &op)
   {
@@ -131,11 +164,42 @@ struct mcode_emu_rand_vals_t : public int64_emulator_t
 
 //-------------------------------------------------------------------------
 bool is_mba(const minsn_t &insn);
+int count_mixed_opc_pairs(mba_t *mba);
+
+//-------------------------------------------------------------------------
+// cheap features of an expression, used to choose the engines for it
+struct mba_features_t
+{
+  int nvars = 0;          // number of input variables
+  int depth = 0;          // depth of the instruction tree
+  int bool_cnt = 0;       // number of boolean operations
+  int arith_cnt = 0;      // number of arithmetic operations
+  bool nonlinear = false; // multiplies two non-constant values
+};
+mba_features_t get_mba_features(const minsn_t &insn);
 
 //-------------------------------------------------------------------------
 bool probably_equivalent(const minsn_t &insn, const candidate_expr_t &expr);
 bool probably_equivalent(const minsn_t &a, const minsn_t &b);
 
+//-------------------------------------------------------------------------
+// random inputs for an expression and its outputs on them. the inputs are
+// drawn and the expression is evaluated only once; then each candidate is
+// evaluated on the same inputs and compared with the stored outputs.
+// the known counterexamples, if any, are tried before the random inputs.
+class test_battery_t
+{
+  std::vector<mcode_emu_rand_vals_t> emus; // the inputs of each test
+  qvector<intval64_t> outputs;             // the outputs of the expression
+
+public:
+  test_battery_t(
+        const minsn_t &insn,
+        const cexes_t *cexes = nullptr,
+        int ntests = NUM_TEST_CASES);
+  bool passes(const minsn_t &cand); // stops at the first mismatch
+};
+
 //-------------------------------------------------------------------------
 // estimates the "complexity" of a given instruction
 int score_complexity(const minsn_t &insn);
@@ -162,4 +226,75 @@ inline mopvec_t get_input_mops(const minsn_t &insn)
 
   std::sort(res.begin(), res.end());
   return res;
-}
\ No newline at end of file
+}
+
+//-------------------------------------------------------------------------
+// same as get_input_mops, but in the order of the first occurrence in the
+// instruction tree. this order does not depend on the registers and stack
+// offsets of the variables, so it can be used to compare the shapes of
+// expressions that come from different functions or databases.
+inline mopvec_t get_input_mops_by_occurrence(const minsn_t &insn)
+{
+  struct ida_local mop_collector_t : public mop_visitor_t
+  {
+    mopvec_t res;
+    int idaapi visit_mop(mop_t *op, const tinfo_t *, bool is_target) override
+    {
+      mopt_t t = op->t;
+      if ( !is_target
+        && (t == mop_r || t == mop_S || t == mop_v || t == mop_l)
+        && !res.has(*op) )
+      {
+        res.push_back(*op);
+      }
+      return 0;
+    }
+  };
+  mop_collector_t mc;
+  const_cast<minsn_t &>(insn).for_all_ops(mc);
+  return mc.res;
+}
+
+//-------------------------------------------------------------------------
+// returns true if the two variables share at least one byte, e.g. al and eax.
+// the locations are the same as those used by byte_val_map_t and
+// z3_converter_t, so non-overlapping variables are independent inputs.
+inline bool mops_overlap(const mop_t &a, const mop_t &b)
+{
+  if ( a.t != b.t )
+    return false;
+  uval_t off1;
+  uval_t off2;
+  switch ( a.t )
+  {
+    case mop_S:
+      off1 = a.s->off;
+      off2 = b.s->off;
+      break;
+    case mop_v:
+      off1 = a.g;
+      off2 = b.g;
+      break;
+    case mop_l:
+      off1 = a.l->off;
+      off2 = b.l->off;
+      break;
+    case mop_r:
+      off1 = a.r;
+      off2 = b.r;
+      break;
+    default:
+      return false;
+  }
+  return off1 < off2 + b.size && off2 < off1 + a.size;
+}
+
+//-------------------------------------------------------------------------
+inline bool have_overlapping_mops(const mopvec_t &mops)
+{
+  for ( size_t i = 0; i < mops.size(); i++ )
+    for ( size_t j = i + 1; j < mops.size(); j++ )
+      if ( mops_overlap(mops[i], mops[j]) )
+        return true;
+  return false;
+}
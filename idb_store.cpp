@@ -0,0 +1,186 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "z3++_no_warn.h"
+#include "idb_store.hpp"
+#include "equiv_class.hpp"
+
+// version of the blob layout, increment on incompatible changes
+const uint32 IDB_STORE_VERSION = 1;
+// netnode blob tag
+const uchar IDB_STORE_TAG = 'G';
+
+//-------------------------------------------------------------------------
+qstring idb_store_t::get_node_name() const
+{
+  qstring name;
+  name.sprnt("$ goomba %a", func_ea);
+  return name;
+}
+
+//-------------------------------------------------------------------------
+void idb_store_t::open(ea_t _func_ea, uint64 _settings)
+{
+  save();
+  func_ea = _func_ea;
+  settings = _settings;
+  records.clear();
+  visited.clear();
+  opened = enabled;
+  if ( !opened )
+    return;
+
+  bytevec_t bv;
+  format_version = minsn_t(0).serialize(&bv);
+  // the netnode is created only when there is something to save
+  node = netnode(get_node_name().c_str());
+  if ( node != BADNODE )
+    load();
+}
+
+//-------------------------------------------------------------------------
+void idb_store_t::load()
+{
+  bytevec_t blob;
+  if ( node.getblob(&blob, 0, IDB_STORE_TAG) <= 0 )
+    return;
+
+  blob_reader_t r(blob);
+  uint32 version;
+  uint32 fmt;
+  uint64 sig;
+  uint32 nrecs;
+  if ( !r.read(&version) || version != IDB_STORE_VERSION
+    || !r.read(&fmt) || fmt != format_version
+    || !r.read(&sig) || sig != settings
+    || !r.read(&nrecs) )
+  {
+    // produced by another version or with other settings, start afresh
+    dirty = true;
+    return;
+  }
+
+  for ( uint32 i = 0; i < nrecs; i++ )
+  {
+    uint64 ea;
+    uint32 size;
+    idb_record_t rec;
+    if ( !r.read(&ea) || !r.read(&rec.hash) || !r.read(&size) || !r.read(&rec.result, size) )
+    {
+      msg("goomba: corrupted results for function at %a, discarded\n", func_ea);
+      records.clear();
+      dirty = true;
+      return;
+    }
+    records[ea_t(ea)].push_back(rec);
+  }
+}
+
+//-------------------------------------------------------------------------
+void idb_store_t::save()
+{
+  if ( !dirty || !opened )
+    return;
+  dirty = false;
+
+  if ( records.empty() )
+  {
+    if ( node != BADNODE )
+      node.kill();
+    node = BADNODE;
+    return;
+  }
+  if ( node == BADNODE )
+    node.create(get_node_name().c_str());
+
+  bytevec_t blob;
+  append_raw(&blob, IDB_STORE_VERSION);
+  append_raw(&blob, format_version);
+  append_raw(&blob, settings);
+  uint32 nrecs = 0;
+  for ( const auto &p : records )
+    nrecs += p.second.size();
+  append_raw(&blob, nrecs);
+  for ( const auto &p : records )
+  {
+    for ( const idb_record_t &rec : p.second )
+    {
+      append_raw(&blob, uint64(p.first));
+      append_raw(&blob, rec.hash);
+      append_raw(&blob, uint32(rec.result.size()));
+      append_bytes(&blob, rec.result);
+    }
+  }
+  node.setblob(blob.begin(), blob.size(), 0, IDB_STORE_TAG);
+}
+
+//-------------------------------------------------------------------------
+int idb_store_t::find(minsn_t **result, const minsn_t &insn, uint64 hash)
+{
+  if ( !opened )
+    return -1;
+
+  ea_t ea = insn.ea;
+  bool first_visit = visited.insert(ea).second;
+  auto p = records.find(ea);
+  if ( p == records.end() )
+    return -1;
+
+  for ( const idb_record_t &rec : p->second )
+  {
+    if ( rec.hash != hash )
+      continue;
+    if ( rec.result.empty() )
+      return 0;
+
+    minsn_t abstract(ea);
+    abstract.deserialize(rec.result.begin(), rec.result.size(), format_version);
+    minsn_t *res = make_concrete_minsn(ea, abstract, get_input_mops(insn), insn.d.size);
+    if ( res == nullptr )
+      return -1;
+    res->optimize_solo();
+    *result = res;
+    return 1;
+  }
+
+  if ( first_visit )
+  {
+    // the microcode at this address is not what it was when the records
+    // were made. they will not match again, forget them.
+    records.erase(p);
+    dirty = true;
+  }
+  return -1;
+}
+
+//-------------------------------------------------------------------------
+void idb_store_t::add(const minsn_t &insn, uint64 hash, const minsn_t *result)
+{
+  if ( !opened )
+    return;
+
+  idb_record_t rec;
+  rec.hash = hash;
+  if ( result != nullptr )
+  {
+    minsn_t *abstract = make_abstract_minsn(*result, get_input_mops(insn));
+    if ( abstract == nullptr )
+      return; // the result refers to a variable that is not an input
+    abstract->serialize(&rec.result);
+    delete abstract;
+  }
+
+  idb_records_t &recs = records[insn.ea];
+  auto p = std::find_if(recs.begin(), recs.end(),
+                        [hash](const idb_record_t &r) { return r.hash == hash; });
+  if ( p != recs.end() )
+    *p = rec;
+  else
+    recs.push_back(rec);
+  dirty = true;
+}
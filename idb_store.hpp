@@ -0,0 +1,105 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+//-------------------------------------------------------------------------
+// helpers to (de)serialize the records
+template <class T>
+inline void append_raw(bytevec_t *bv, const T &v)
+{
+  size_t off = bv->size();
+  bv->resize(off + sizeof(v));
+  memcpy(bv->begin() + off, &v, sizeof(v));
+}
+
+inline void append_bytes(bytevec_t *bv, const bytevec_t &src)
+{
+  size_t off = bv->size();
+  bv->resize(off + src.size());
+  memcpy(bv->begin() + off, src.begin(), src.size());
+}
+
+//-------------------------------------------------------------------------
+// sequential reader of a blob, all reads fail once the end is reached
+struct blob_reader_t
+{
+  const uchar *ptr;
+  const uchar *end;
+  blob_reader_t(const bytevec_t &bv) : ptr(bv.begin()), end(bv.end()) {}
+
+  template <class T>
+  bool read(T *v)
+  {
+    if ( size_t(end - ptr) < sizeof(*v) )
+      return false;
+    memcpy(v, ptr, sizeof(*v));
+    ptr += sizeof(*v);
+    return true;
+  }
+
+  bool read(bytevec_t *bv, uint32 size)
+  {
+    if ( size_t(end - ptr) < size )
+      return false;
+    bv->resize(size);
+    memcpy(bv->begin(), ptr, size);
+    ptr += size;
+    return true;
+  }
+};
+
+//-------------------------------------------------------------------------
+// one known outcome of the optimizer for an instruction
+struct idb_record_t
+{
+  uint64 hash;        // structural hash of the original instruction, see insn_cache.hpp
+  bytevec_t result;   // serialized abstract minsn, empty if all engines failed
+};
+typedef qvector<idb_record_t> idb_records_t;
+
+//-------------------------------------------------------------------------
+// persists the results of the optimizer in the database, so that decompiling
+// a function again does not redo the candidate search and the proofs.
+// each function has its own netnode with a single blob that holds all
+// records of the function, keyed by the instruction address and hash.
+// results are stored in abstract form (see make_abstract_minsn) because
+// deserialized stack variables would not be attached to the current mba.
+class idb_store_t
+{
+  netnode node;
+  ea_t func_ea = BADADDR;
+  std::map<ea_t, idb_records_t> records;
+  std::set<ea_t> visited;   // addresses looked up during this decompilation
+  uint32 format_version = 0;
+  uint64 settings = 0;      // optimizer settings the records were produced with
+  bool opened = false;
+  bool dirty = false;
+
+  qstring get_node_name() const;
+  void load();
+
+public:
+  bool enabled = true;
+
+  // settings: a signature of the optimizer configuration. if it does not
+  // match the stored one, all records of the function are discarded.
+  void open(ea_t func_ea, uint64 settings);
+  // writes the records to the database if they were modified
+  void save();
+
+  // returns 1 and the concrete result if the instruction is known to be
+  // simplifiable, 0 if it is known to fail, -1 if it is unknown.
+  // records at the address of the instruction that do not match the hash
+  // are discarded on the first lookup: the code at the address has changed.
+  int find(minsn_t **result, const minsn_t &insn, uint64 hash);
+
+  // result == nullptr means that the instruction could not be simplified
+  void add(const minsn_t &insn, uint64 hash, const minsn_t *result);
+};
@@ -0,0 +1,209 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "z3++_no_warn.h"
+#include "insn_cache.hpp"
+#include "equiv_class.hpp"
+
+//-------------------------------------------------------------------------
+// FNV-1a over the opcodes, operand types, sizes, and values of the tree
+struct minsn_hasher_t
+{
+  uint64 sum = 0xcbf29ce484222325;
+  // if set, the subinstructions are added by their hashes
+  std::map<const minsn_t *, uint64> *subtrees = nullptr;
+
+  void add(uint64 v)
+  {
+    sum ^= v;
+    sum *= 0x100000001b3;
+  }
+
+  void add_mop(const mop_t &op)
+  {
+    add(op.t);
+    add(op.size);
+    switch ( op.t )
+    {
+      case mop_n:
+        add(op.nnn->value);
+        break;
+      case mop_r:
+        add(op.r);
+        break;
+      case mop_S:
+        add(op.s->off);
+        break;
+      case mop_v:
+        add(op.g);
+        break;
+      case mop_l:
+        add(op.l->idx);
+        add(op.l->off);
+        break;
+      case mop_d:
+        if ( subtrees != nullptr )
+          add(hash_minsn_subtrees(subtrees, *op.d));
+        else
+          add_insn(*op.d);
+        break;
+      case mop_p:
+        add_mop(op.pair->lop);
+        add_mop(op.pair->hop);
+        break;
+      default:
+        // other operand types never appear in MBA expressions,
+        // collisions are resolved by comparing the instructions anyway
+        break;
+    }
+  }
+
+  void add_insn(const minsn_t &insn)
+  {
+    add(insn.opcode);
+    add(insn.d.size);
+    add_mop(insn.l);
+    add_mop(insn.r);
+  }
+};
+
+//-------------------------------------------------------------------------
+uint64 hash_minsn(const minsn_t &insn)
+{
+  minsn_hasher_t hasher;
+  hasher.add_insn(insn);
+  return hasher.sum;
+}
+
+//-------------------------------------------------------------------------
+uint64 hash_minsn_subtrees(std::map<const minsn_t *, uint64> *out, const minsn_t &insn)
+{
+  minsn_hasher_t hasher;
+  hasher.subtrees = out;
+  hasher.add_insn(insn);
+  out->insert( { &insn, hasher.sum } );
+  return hasher.sum;
+}
+
+//-------------------------------------------------------------------------
+void insn_cache_t::clear()
+{
+  for ( auto &p : entries )
+  {
+    delete p.second.orig;
+    delete p.second.result;
+  }
+  entries.clear();
+  for ( auto &p : templates )
+  {
+    delete p.second.orig;
+    delete p.second.result;
+  }
+  templates.clear();
+  nhits = 0;
+}
+
+//-------------------------------------------------------------------------
+const insn_cache_entry_t *insn_cache_t::find(const minsn_t &insn, uint64 hash) const
+{
+  auto p = entries.find(hash);
+  if ( p == entries.end() )
+    return nullptr;
+  const minsn_t *orig = p->second.orig;
+  if ( orig->d.size != insn.d.size || !orig->equal_insns(insn, 0) )
+    return nullptr; // hash collision
+  return &p->second;
+}
+
+//-------------------------------------------------------------------------
+void insn_cache_t::add(const minsn_t &insn, uint64 hash, const minsn_t *result)
+{
+  insn_cache_entry_t &e = entries[hash];
+  // in the unlikely case of a collision, the newer instruction wins
+  delete e.orig;
+  delete e.result;
+  e.orig = new minsn_t(insn);
+  e.result = result != nullptr ? new minsn_t(*result) : nullptr;
+}
+
+//-------------------------------------------------------------------------
+// returns the canonical form of the instruction and its input variables
+static minsn_t *make_template_key(mopvec_t *vars, const minsn_t &insn)
+{
+  *vars = get_input_mops_by_occurrence(insn);
+  if ( have_overlapping_mops(*vars) )
+    return nullptr;
+  return make_abstract_minsn(insn, *vars);
+}
+
+//-------------------------------------------------------------------------
+minsn_t *insn_cache_t::instantiate(const minsn_t &insn)
+{
+  if ( templates.empty() )
+    return nullptr;
+
+  mopvec_t vars;
+  minsn_t *abstract = make_template_key(&vars, insn);
+  if ( abstract == nullptr )
+    return nullptr;
+
+  minsn_t *res = nullptr;
+  auto p = templates.find(hash_minsn(*abstract));
+  if ( p != templates.end() )
+  {
+    insn_template_t &tpl = p->second;
+    if ( tpl.orig->d.size == abstract->d.size && tpl.orig->equal_insns(*abstract, 0) )
+    {
+      res = make_concrete_minsn(insn.ea, *tpl.result, vars, insn.d.size);
+      if ( res != nullptr )
+      {
+        res->optimize_solo();
+        tpl.ninstances++;
+      }
+    }
+  }
+  delete abstract;
+  return res;
+}
+
+//-------------------------------------------------------------------------
+void insn_cache_t::add_template(const minsn_t &insn, const minsn_t &result)
+{
+  mopvec_t vars;
+  minsn_t *abstract = make_template_key(&vars, insn);
+  if ( abstract == nullptr )
+    return;
+  minsn_t *abstract_result = make_abstract_minsn(result, vars);
+  if ( abstract_result == nullptr )
+  {
+    delete abstract;
+    return;
+  }
+
+  insn_template_t &tpl = templates[hash_minsn(*abstract)];
+  // in the unlikely case of a collision, the newer instruction wins
+  delete tpl.orig;
+  delete tpl.result;
+  tpl.orig = abstract;
+  tpl.result = abstract_result;
+  tpl.ea = insn.ea;
+  tpl.text = insn.dstr();
+  tpl.ninstances = 0;
+}
+
+//-------------------------------------------------------------------------
+void insn_cache_t::print_templates() const
+{
+  for ( const auto &p : templates )
+  {
+    const insn_template_t &tpl = p.second;
+    if ( tpl.ninstances != 0 )
+      msg("goomba: %a: result for %s reused for %d other instances\n",
+          tpl.ea, tpl.text.c_str(), tpl.ninstances);
+  }
+}
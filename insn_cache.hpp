@@ -0,0 +1,86 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+//-------------------------------------------------------------------------
+// computes a structural hash of the instruction tree. the instruction
+// address and the destination operand are not included, only the opcodes,
+// operands, and sizes of the expression.
+uint64 hash_minsn(const minsn_t &insn);
+
+//-------------------------------------------------------------------------
+// computes the structural hashes of all the subinstructions of the tree in
+// one pass, from the bottom up. the hash of an instruction is made of the
+// hashes of its subinstructions, so these hashes differ from hash_minsn().
+uint64 hash_minsn_subtrees(std::map<const minsn_t *, uint64> *out, const minsn_t &insn);
+
+//-------------------------------------------------------------------------
+struct insn_cache_entry_t
+{
+  minsn_t *orig = nullptr;    // copy of the original instruction, to rule out hash collisions
+  minsn_t *result = nullptr;  // proven simplification, nullptr if all engines failed
+};
+
+//-------------------------------------------------------------------------
+// a simplification in canonical form (see get_input_mops_by_occurrence),
+// applicable to every instruction with the same shape
+struct insn_template_t
+{
+  minsn_t *orig = nullptr;    // canonical form of the first instance
+  minsn_t *result = nullptr;  // canonical form of its simplification
+  ea_t ea = BADADDR;          // address of the first instance
+  qstring text;               // text of the first instance, for the report
+  int ninstances = 0;         // number of other instances that reused the result
+};
+
+//-------------------------------------------------------------------------
+// remembers the outcome of the optimizer for every MBA instruction of the
+// current function, so that identical expressions (and expressions that
+// are seen again during a later pass) are not processed twice.
+// in addition, simplifications are remembered as templates, so that copies
+// of the same expression with other registers or stack variables reuse the
+// result instead of being processed again.
+// the cache refers to stack variables of the mba_t, so it must be reset
+// for every new microcode object.
+class insn_cache_t
+{
+  std::map<uint64, insn_cache_entry_t> entries;
+  std::map<uint64, insn_template_t> templates;
+  const mba_t *owner = nullptr;
+
+public:
+  int nhits = 0;    // number of lookups answered by the cache
+
+  ~insn_cache_t() { clear(); }
+
+  //-------------------------------------------------------------------------
+  // forget all entries if they were collected for a different mba
+  void reset(const mba_t *mba)
+  {
+    clear();
+    owner = mba;
+  }
+  bool belongs_to(const mba_t *mba) const { return owner == mba; }
+
+  void clear();
+  const insn_cache_entry_t *find(const minsn_t &insn, uint64 hash) const;
+  // result == nullptr means that the instruction could not be simplified
+  void add(const minsn_t &insn, uint64 hash, const minsn_t *result);
+
+  // returns the simplification of the instruction obtained from a template
+  // with the same shape, or nullptr
+  minsn_t *instantiate(const minsn_t &insn);
+  // remembers the simplification as a template. instructions with
+  // overlapping inputs are not eligible: their simplification depends on
+  // how the inputs overlap.
+  void add_template(const minsn_t &insn, const minsn_t &result);
+  // prints the templates that were used more than once
+  void print_templates() const;
+};
@@ -64,7 +64,7 @@ public:
   //-------------------------------------------------------------------------
   // each boolean assignment is represented as a uint32, where the nth bit
   // represents the 0/1 value of the corresponding variable
-  void apply_assignment(uint32 assn, std::map<const mop_t, intval64_t> &dest)
+  static void apply_assignment(uint32 assn, std::map<const mop_t, intval64_t> &dest)
   {
     // recall std::map keeps keys in sorted order
     int curr_idx = 0;
@@ -75,6 +75,44 @@ public:
     }
   }
 
+  //-------------------------------------------------------------------------
+  // evaluates the instruction for all the assignments of its variables, in
+  // the order of apply_assignment. the variables are returned in 'mops'.
+  // fails if there are more than 'max_vars' of them.
+  static bool compute_eval_trace(
+        eval_trace_t *trace,
+        mopvec_t *mops,
+        const minsn_t &insn,
+        int max_vars)
+  {
+    default_zero_mcode_emu_t emu;
+    intval64_t const_term = emu.minsn_value(insn);     // first-time emulation returns the result when setting all inputs as 0
+
+    int nvars = emu.assigned_vals.size();
+    if ( nvars > max_vars )
+      return false;
+
+    uint32 max_assignment = 1 << nvars;       // 2^n possible values in the truth table
+    // we have already gotten the value for the all-zeroes assignment, which is const_term
+    trace->clear();
+    trace->reserve(max_assignment);
+    trace->push_back(const_term);
+
+    // Compute signature vectors
+    for ( uint32 assn = 1; assn < max_assignment; assn++ )
+    {
+      apply_assignment(assn, emu.assigned_vals);
+      trace->push_back(emu.minsn_value(insn));
+    }
+
+    // Collect all the input operands from the emulator
+    mops->clear();
+    mops->reserve(emu.assigned_vals.size());
+    for ( const auto &kv : emu.assigned_vals )
+      mops->push_back(kv.first);
+    return true;
+  }
+
   //-------------------------------------------------------------------------
   // the i'th index in output_vals contains the output value corresponding to
   // the i'th assignment, where the i'th assignment is defined as in
@@ -142,33 +180,10 @@ public:
   // creates a linear combination of conjunctions based on the minsn behavior
   lin_conj_expr_t(const minsn_t &insn)
   {
-    default_zero_mcode_emu_t emu;
-    intval64_t const_term = emu.minsn_value(insn);     // first-time emulation returns the result when setting all inputs as 0
-
-    int nvars = emu.assigned_vals.size();
-    if ( nvars > LIN_CONJ_MAX_VARS )
+    if ( !compute_eval_trace(&eval_trace, &mops, insn, LIN_CONJ_MAX_VARS) )
       throw "lin_conj_expr_t: too many input variables";
-
-    uint32 max_assignment = 1 << nvars;       // 2^n possible values in the truth table
-    // we have already gotten the value for the all-zeroes assignment, which is const_term
-    eval_trace.push_back(const_term);
-    eval_trace.reserve(max_assignment);
-
-    // Compute signature vectors
-    for ( uint32 assn = 1; assn < max_assignment; assn++ )
-    {
-      apply_assignment(assn, emu.assigned_vals);
-      intval64_t output_val = emu.minsn_value(insn);
-
-      eval_trace.push_back(output_val);
-    }
     compute_coeffs(coeffs, eval_trace);
 
-    // Collect all the input operands from the emulator
-    mops.reserve(emu.assigned_vals.size());
-    for ( const auto &kv : emu.assigned_vals )
-      mops.push_back(kv.first);
-
     QASSERT(30679, coeffs.size() == (1ull << mops.size()));
   }
 
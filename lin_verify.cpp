@@ -0,0 +1,137 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "lin_verify.hpp"
+#include "heuristics.hpp"
+
+//-------------------------------------------------------------------------
+static bool is_var(const mop_t &op)
+{
+  return op.t == mop_r || op.t == mop_S || op.t == mop_v || op.t == mop_l;
+}
+
+//-------------------------------------------------------------------------
+// each bit of a bitwise function depends only on the same bit of the
+// variables. this is why the constants must be 0 or -1.
+static bool is_bitwise(const mop_t &op, int size)
+{
+  if ( op.size != size )
+    return false;
+  if ( op.t == mop_n )
+    return op.nnn->value == 0 || op.nnn->value == make_mask<uint64>(size * 8);
+  if ( is_var(op) )
+    return true;
+  if ( op.t != mop_d || op.d->d.size != size )
+    return false;
+  const minsn_t &ins = *op.d;
+  switch ( ins.opcode )
+  {
+    case m_and:
+    case m_or:
+    case m_xor:
+      return is_bitwise(ins.l, size) && is_bitwise(ins.r, size);
+    case m_bnot:
+    case m_mov:
+    case m_ldc:
+      return is_bitwise(ins.l, size);
+    default:
+      return false;
+  }
+}
+
+//-------------------------------------------------------------------------
+static bool is_linear_insn(const minsn_t &ins, int size);
+static bool is_linear(const mop_t &op, int size)
+{
+  if ( op.size != size )
+    return false;
+  if ( op.t == mop_n || is_var(op) )
+    return true;
+  return op.t == mop_d && is_linear_insn(*op.d, size);
+}
+
+//-------------------------------------------------------------------------
+static bool is_linear_insn(const minsn_t &ins, int size)
+{
+  if ( ins.d.size != size || ins.is_fpinsn() )
+    return false;
+  switch ( ins.opcode )
+  {
+    case m_add:
+    case m_sub:
+      return is_linear(ins.l, size) && is_linear(ins.r, size);
+    case m_neg:
+    case m_bnot:  // ~a == -a - 1
+    case m_mov:
+    case m_ldc:
+      return is_linear(ins.l, size);
+    case m_mul:
+      return (ins.l.t == mop_n && ins.l.size == size && is_linear(ins.r, size))
+          || (ins.r.t == mop_n && ins.r.size == size && is_linear(ins.l, size));
+    case m_shl:   // a multiplication by a power of 2
+      return ins.r.t == mop_n && is_linear(ins.l, size);
+    case m_and:
+    case m_or:
+    case m_xor:
+      return is_bitwise(ins.l, size) && is_bitwise(ins.r, size);
+    default:
+      return false;
+  }
+}
+
+//-------------------------------------------------------------------------
+bool is_linear_mba(const minsn_t &insn)
+{
+  int size = insn.d.size;
+  if ( size != 1 && size != 2 && size != 4 && size != 8 )
+    return false;
+  return is_linear_insn(insn, size);
+}
+
+//-------------------------------------------------------------------------
+linear_verifier_t::linear_verifier_t(const minsn_t &orig)
+{
+  if ( !is_linear_mba(orig) )
+    return;
+  if ( !lin_conj_expr_t::compute_eval_trace(&orig_trace, &mops, orig, LIN_VERIFY_MAX_VARS) )
+    return;
+  // al and eax are not independent variables, the theorem does not apply
+  if ( have_overlapping_mops(mops) )
+    return;
+  occurrences = get_input_mops_by_occurrence(orig);
+  linear = true;
+}
+
+//-------------------------------------------------------------------------
+native_verdict_t linear_verifier_t::verify(const minsn_t &cand, cex_t *cex) const
+{
+  if ( !linear || cand.d.size != orig_trace[0].size || !is_linear_mba(cand) )
+    return NV_UNKNOWN;
+
+  default_zero_mcode_emu_t emu;
+  for ( const mop_t &mop : mops )
+    emu.assigned_vals.insert( { mop, intval64_t(0, mop.size) } );
+  for ( uint32 assn = 0; assn < orig_trace.size(); assn++ )
+  {
+    lin_conj_expr_t::apply_assignment(assn, emu.assigned_vals);
+    intval64_t val = emu.minsn_value(cand);
+    if ( emu.assigned_vals.size() != mops.size() )
+      return NV_UNKNOWN; // the candidate uses a variable of its own
+    if ( val != orig_trace[assn] )
+    {
+      cex->clear();
+      for ( const mop_t &op : occurrences )
+      {
+        const mop_t *p = std::find(mops.begin(), mops.end(), op);
+        cex->push_back(p != mops.end() ? (assn >> (p - mops.begin())) & 1 : 0);
+      }
+      return NV_DIFFERENT;
+    }
+  }
+  return NV_EQUIVALENT;
+}
@@ -0,0 +1,49 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+#include "cex_store.hpp"
+#include "lin_conj_exprs.hpp"
+
+// the truth tables have 2^n entries, n being the number of variables
+const int LIN_VERIFY_MAX_VARS = LIN_CONJ_MAX_VARS;
+
+//-------------------------------------------------------------------------
+// returns true if the instruction is a linear MBA: a linear combination of
+// bitwise functions of its variables, e.g. 3*(x&y) - 2*~(x^y) + 5.
+// all the subexpressions and variables must have the size of the result.
+// the only constants allowed inside the bitwise functions are 0 and -1.
+bool is_linear_mba(const minsn_t &insn);
+
+//-------------------------------------------------------------------------
+// the answer of a verifier that does not need z3
+enum native_verdict_t
+{
+  NV_UNKNOWN,     // out of the scope of the verifier, left to z3
+  NV_EQUIVALENT,  // equal for all inputs
+  NV_DIFFERENT,   // the counterexample tells them apart
+};
+
+//-------------------------------------------------------------------------
+// the native proof of linear candidates. two linear MBAs are equal for all
+// inputs if and only if they are equal when each variable is 0 or 1 (see
+// the SiMBA paper), so comparing the truth tables of the expressions, as
+// computed by lin_conj_expr_t, is an exact proof that needs no z3.
+class linear_verifier_t
+{
+  mopvec_t mops;            // the variables, in the order of the truth table
+  mopvec_t occurrences;     // the same, in the order of the counterexamples
+  eval_trace_t orig_trace;  // the values of the original for each assignment
+  bool linear = false;
+
+public:
+  linear_verifier_t(const minsn_t &orig);
+  // the inputs of an NV_DIFFERENT verdict are returned in 'cex'
+  native_verdict_t verify(const minsn_t &cand, cex_t *cex) const;
+};
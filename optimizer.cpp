@@ -7,6 +7,9 @@
  */
 
 #include <chrono>
+#include <future>
+#include <thread>
+#include <set>
 
 #include "z3++_no_warn.h"
 #include "optimizer.hpp"
@@ -26,88 +29,370 @@ inline void set_cmt(ea_t ea, const char *cmt)
 }
 
 //--------------------------------------------------------------------------
-static bool check_and_substitute(
-        minsn_t *insn,
-        minsn_t *cand_insn,
-        uint z3_timeout,
-        bool z3_assume_timeouts_correct)
+// proves the candidates one by one, the simplest first, and stops at the
+// first one that is accepted. the original is asserted in each solver once,
+// each candidate is checked in its own scope, so the lemmas learned about
+// the original are reused. may run on any thread, so the messages are
+// collected in 'log' and printed by finish_insn().
+void proof_task_t::prove(bool assume_timeouts_correct)
 {
-  bool ok = false;
-  int original_score = score_complexity(*insn);
-  int candidate_score = score_complexity(*cand_insn);
-  msg("goomba: testing candidate: %s\n", cand_insn->dstr());
-  if ( candidate_score > original_score )
+  size_t n = queries.size();
+  checks.clear();
+  for ( size_t i = 0; i < candidates.size() && !interrupted; i++ )
   {
-    msg("goomba: candidate (%d) is not simpler than original (%d), skipping\n", candidate_score, original_score);
-  }
-  else
-  {
-    z3_converter_t converter;
-    if ( probably_equivalent(*insn, *cand_insn) )
+    if ( int(i) == verified )
     {
-      msg("goomba: instruction is probably equivalent to candidate\n");
-      if ( skip_proofs() || z3_timeout == 0 )
+      log.cat_sprnt("goomba: candidate %" FMT_Z " was proved without z3\n", i);
+      result = i;
+      proved = true;
+      break;
+    }
+    qvector<z3::check_result> res;
+    res.resize(n, z3::check_result::unknown);
+    qstrvec_t logs;
+    logs.resize(n);
+    cexes_t found;
+    found.resize(n);
+    std::vector<char> failed(n, 0);
+    std::vector<int64> usecs(n, -1); // -1 if the check did not run
+    std::atomic<int> winner(-1);
+    std::atomic<size_t> nfinished(0);
+    auto run = [&](size_t k)
+    {
+      if ( winner >= 0 )
       {
-        set_cmt(insn->ea, "goomba: z3 proof skipped, simplification assumed correct");
-        ok = true;
+        nfinished++;
+        return; // another query has already answered
       }
-      else
+      bool f = false;
+      auto start = std::chrono::high_resolution_clock::now();
+      res[k] = queries[k]->check(i, timeout, &found[k], &logs[k], &f);
+      auto end = std::chrono::high_resolution_clock::now();
+      usecs[k] = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+      failed[k] = f;
+      int none = -1;
+      if ( queries[k]->is_definite(res[k]) && winner.compare_exchange_strong(none, int(k)) )
       {
-        z3::expr lge = converter.minsn_to_expr(*cand_insn);
-        z3::expr ie = converter.minsn_to_expr(*insn);
-        // msg("lge: %s\n", lge.to_string().c_str());
-        // msg("ie: %s\n", ie.to_string().c_str());
-        z3::solver s(converter.context);
-        s.set("timeout", z3_timeout);
-        s.add(lge != ie);
-        z3::check_result res = s.check();
-        msg("goomba: SMT check result: %d\n", res);
-        if ( res == z3::check_result::sat )
+        // a query that was between the winner check above and the start of
+        // its solver would miss a single interrupt, so the others are
+        // interrupted until they all return. interrupting a finished query
+        // is harmless.
+        while ( true )
         {
-          msg("Satisfiable. Counterexample: \n");
-          z3::model m = s.get_model();
-          for ( unsigned i = 0; i < m.size(); i++ )
-          {
-            z3::func_decl v = m[i];
-            msg("%s = %s\n", v.name().str().c_str(), m.get_const_interp(v).to_string().c_str());
-          }
+          for ( size_t j = 0; j < n; j++ )
+            if ( j != k )
+              queries[j]->interrupt_check();
+          if ( nfinished == n - 1 )
+            break;
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
+      }
+      nfinished++;
+    };
+    std::vector<std::future<void>> others;
+    for ( size_t k = 1; k < n; k++ )
+      others.push_back(std::async(std::launch::async, run, k));
+    run(0);
+    for ( auto &f : others )
+      f.get();
+    for ( const qstring &l : logs )
+      log.append(l);
+    for ( size_t k = 0; k < n; k++ )
+      if ( usecs[k] >= 0 )
+        checks.push_back({ i, k, res[k], usecs[k] });
 
-        if ( res == z3::check_result::unsat )
-        {
-          ok = true;
-        }
+    int w = winner;
+    if ( w >= 0 && res[w] == z3::check_result::sat )
+      cexes.push_back(found[w]);
 
-        if ( z3_assume_timeouts_correct && res == z3::check_result::unknown )
-        {
-          bool add_cmt = true;
+    if ( w >= 0 && res[w] == z3::check_result::unsat )
+    {
+      result = i;
+      proved = true;
+      break;
+    }
+
+    // a check interrupted because the time ran out proves nothing,
+    // neither does a failed one
+    bool timed_out = false;
+    for ( size_t k = 0; k < n; k++ )
+      if ( res[k] == z3::check_result::unknown && !failed[k] && !queries[k]->strategy.narrow )
+        timed_out = true;
+    // near the deadline, the timeout is cut to the time left. such a
+    // timeout says nothing about the candidate: the proof is given up as
+    // if it was interrupted, and its failure is not remembered.
+    if ( w < 0 && timed_out && timeout_cut )
+    {
+      interrupted = true;
+      break;
+    }
+    if ( assume_timeouts_correct && w < 0 && timed_out && !interrupted )
+    {
+      result = i;
+      break;
+    }
+  }
+}
+
+//--------------------------------------------------------------------------
+void proof_task_t::interrupt()
+{
+  interrupted = true;
+  for ( smt_query_t *q : queries )
+  {
+    q->converter.context.interrupt();
+    q->interrupt_check(); // kills the z3 process, if any
+  }
+}
+
+//--------------------------------------------------------------------------
+// the time is up before the proof could start. a candidate proved without
+// z3 is still sound, the others are dropped as if they were interrupted.
+void proof_task_t::give_up()
+{
+  if ( verified >= 0 )
+  {
+    log.cat_sprnt("goomba: candidate %d was proved without z3\n", verified);
+    result = verified;
+    proved = true;
+  }
+  else
+  {
+    interrupted = true;
+  }
+}
+
+//--------------------------------------------------------------------------
+// proves the tasks on up to get_nthreads() threads. the main thread watches
+// the deadline and the cancel button meanwhile, and interrupts the proofs
+// when the time is up.
+void optimizer_t::run_tasks(const proof_tasks_t &tasks)
+{
+  size_t nworkers = qmin(size_t(get_nthreads()), tasks.size());
+  if ( nworkers <= 1 && budget == 0 && !cancellable )
+  {
+    for ( proof_task_t *task : tasks )
+      task->prove(z3_assume_timeouts_correct);
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  auto worker = [&]()
+  {
+    for ( size_t i = next++; i < tasks.size(); i = next++ )
+      tasks[i]->prove(z3_assume_timeouts_correct);
+  };
+  std::vector<std::future<void>> workers;
+  for ( size_t k = 0; k < nworkers; k++ )
+    workers.push_back(std::async(std::launch::async, worker));
+
+  bool interrupted = false;
+  for ( auto &w : workers )
+  {
+    while ( w.wait_for(std::chrono::milliseconds(SOLVER_POLL_INTERVAL)) != std::future_status::ready )
+    {
+      if ( !interrupted && should_stop() )
+      {
+        interrupted = true;
+        for ( proof_task_t *task : tasks )
+          task->interrupt();
+      }
+    }
+    w.get();
+  }
+}
+
+//--------------------------------------------------------------------------
+// applies the result of the proof to the microcode and deletes the task.
+// if all candidates were refuted, the remaining engines of the plan run here.
+bool optimizer_t::finish_insn(proof_task_t *task)
+{
+  msg("%s", task->log.c_str());
+  capture_checks(task);
+  for ( const cex_t &cex : task->cexes )
+    cex_store.add(cex);
+  while ( task->result < 0 && !task->interrupted && generate_candidates(task) )
+  {
+    task->log.clear();
+    task->cexes.clear();
+    proof_tasks_t tasks;
+    tasks.push_back(task);
+    run_tasks(tasks);
+    msg("%s", task->log.c_str());
+    capture_checks(task);
+    for ( const cex_t &cex : task->cexes )
+      cex_store.add(cex);
+  }
+
+  bool success = task->result >= 0;
+  if ( success )
+  {
+    minsn_t *cand = task->candidates[task->result];
+    engine_stats[task->plan[task->next_engine - 1]].nwins++;
+    if ( !task->proved )
+    {
+      bool add_cmt = true;
 #ifdef TESTABLE_BUILD
-          // when running the testable build, do not append comments about z3 timeouts
-          if ( add_cmt )
-          {
-            qstring dummy;
-            if ( qgetenv("IDA_TEST_NAME", &dummy) )
-              add_cmt = false;
-          }
-#endif
-          if ( add_cmt )
-            set_cmt(insn->ea, "goomba: z3 proof timed out, simplification assumed correct");
-          ok = true;
-        }
+      // when running the testable build, do not append comments about z3 timeouts
+      if ( add_cmt )
+      {
+        qstring dummy;
+        if ( qgetenv("IDA_TEST_NAME", &dummy) )
+          add_cmt = false;
       }
+#endif
+      if ( add_cmt )
+        set_cmt(task->insn->ea, "goomba: z3 proof timed out, simplification assumed correct");
+    }
+    msg("goomba: SUCCESS: %s\n", cand->dstr());
+    substitute(task->insn, cand);
+    if ( qgetenv("VD_MBA_LOG_PERF") )
+      msg("%s", task->perf.c_str());
+    auto end_time = std::chrono::high_resolution_clock::now();
+    msg("goomba: Time taken: %" FMT_64 "d us\n",
+      std::chrono::duration_cast<std::chrono::microseconds>(end_time - task->start_time).count());
+  }
+  add_result(task->orig, task->hash, success ? task->insn : nullptr, task->proved, task->interrupted);
+  delete task;
+  return success;
+}
+
+//--------------------------------------------------------------------------
+// saves each z3 check of the last proof of the task as an SMT-LIB script.
+// the metadata in the comments at the top is read by tools/smt_replay.cpp.
+// the file names are made of the instruction and the candidate, so that
+// decompiling the same function again overwrites the same files.
+void optimizer_t::capture_checks(const proof_task_t *task)
+{
+  if ( capture_dir.empty() )
+    return;
+  static const char *const result_names[] = { "unsat", "sat", "unknown" };
+  for ( const proof_task_t::check_record_t &c : task->checks )
+  {
+    smt_query_t *q = task->queries[c.query];
+    qstring text;
+    try
+    {
+      q->to_smt2(&text, c.cand, task->timeout);
     }
-    else
+    catch ( const z3::exception &e )
     {
-      msg("goomba: candidate not equivalent, skipping\n");
+      msg("goomba: z3 error: %s\n", e.msg());
+      continue;
     }
+    char name[QMAXPATH];
+    qsnprintf(name, sizeof(name), "%016" FMT_64 "x_e%" FMT_Z "_c%" FMT_Z "_q%" FMT_Z ".smt2",
+              task->hash, task->next_engine, c.cand, c.query);
+    char path[QMAXPATH];
+    qmakepath(path, sizeof(path), capture_dir.c_str(), name, nullptr);
+    FILE *fp = qfopen(path, "w");
+    if ( fp == nullptr )
+    {
+      msg("goomba: cannot create %s, the z3 checks are not captured\n", path);
+      capture_dir.clear();
+      return;
+    }
+    qfprintf(fp, "; ea: %a\n", task->orig.ea);
+    qfprintf(fp, "; original: %s\n", task->orig.dstr());
+    qfprintf(fp, "; candidate: %s\n", task->candidates[c.cand]->dstr());
+    qfprintf(fp, "; source: %s\n", task->source != nullptr ? task->source : "unknown");
+    qfprintf(fp, "; strategy: %s\n", q->strategy.dstr().c_str());
+    qfprintf(fp, "; timeout: %u ms\n", task->timeout);
+    qfprintf(fp, "; result: %s\n", result_names[c.res]);
+    qfprintf(fp, "; time: %" FMT_64 "d us\n", c.usecs);
+    qfprintf(fp, "%s", text.c_str());
+    qfclose(fp);
   }
+}
+
+//--------------------------------------------------------------------------
+void optimizer_t::start(const mba_t *mba, uint max_budget)
+{
+  if ( !cache.belongs_to(mba) )
+    cache.reset(mba);
+  store.open(mba->entry_ea, settings_signature());
+  budget = func_time_budget;
+  if ( max_budget != 0 && (budget == 0 || budget > max_budget) )
+    budget = max_budget;
+  deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budget);
+  stopped = false;
+  if ( processes.enabled() )
+    processes.warm_up(get_nthreads());
+  if ( !capture_dir.empty() )
+    qmkdir(capture_dir.c_str(), 0755); // fails if it exists
+}
 
-  if ( ok )
+//--------------------------------------------------------------------------
+bool optimizer_t::should_stop()
+{
+  if ( !stopped )
   {
-    msg("goomba: SUCCESS: %s\n", cand_insn->dstr());
-    substitute(insn, cand_insn);
+    if ( budget != 0 && std::chrono::steady_clock::now() >= deadline )
+    {
+      msg("goomba: the time budget of the function is exhausted\n");
+      stopped = true;
+    }
+    else if ( cancellable && user_cancelled() )
+    {
+      msg("goomba: cancelled by the user\n");
+      stopped = true;
+    }
   }
-  return ok;
+  return stopped;
+}
+
+//--------------------------------------------------------------------------
+uint optimizer_t::get_z3_timeout() const
+{
+  if ( budget == 0 )
+    return z3_timeout;
+  auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+  return uint(qmax(qmin(int64(z3_timeout), int64(left)), int64(1)));
+}
+
+//--------------------------------------------------------------------------
+uint optimizer_t::get_nthreads() const
+{
+  if ( nthreads != 0 )
+    return nthreads;
+  return qmax(std::thread::hardware_concurrency(), 1u);
+}
+
+//--------------------------------------------------------------------------
+uint64 optimizer_t::settings_signature() const
+{
+  // results obtained without the oracle or with other proof settings
+  // must not be reused
+  struct sig_hasher_t
+  {
+    uint64 sum = 0xcbf29ce484222325;
+    void add(uint64 v)
+    {
+      sum ^= v;
+      sum *= 0x100000001b3;
+    }
+  };
+  sig_hasher_t h;
+  h.add(equiv_classes != nullptr);
+  h.add(z3_timeout);
+  h.add(z3_assume_timeouts_correct);
+  h.add(skip_proofs());
+  h.add(exhaustive_bits);
+  h.add(pass_settings);
+  // a z3 process is killed shortly after the timeout, and the kills count
+  // as timeouts: its results differ from those of the library
+  for ( size_t i = 0; i < processes.path.length(); i++ )
+    h.add(uchar(processes.path[i]));
+  for ( size_t i = 0; i < portfolio.size() && i < portfolio_size; i++ )
+  {
+    const smt_strategy_t &s = portfolio[i];
+    for ( size_t j = 0; j < s.tactics.length(); j++ )
+      h.add(uchar(s.tactics[j]));
+    h.add(s.seed);
+    h.add(s.narrow);
+  }
+  return h.sum;
 }
 
 //--------------------------------------------------------------------------
@@ -140,100 +425,463 @@ bool optimizer_t::optimize_insn_recurse(minsn_t *insn)
 }
 
 //--------------------------------------------------------------------------
-static void add_candidate(minsnptrs_t *out, minsn_t *cand, const char *source)
+bool candidate_pool_t::add(minsn_t *cand, const char *source)
 {
   cand->optimize_solo();
   msg("goomba: %s guess: %s\n", source, cand->dstr());
-  out->push_back(cand);
+  if ( !seen.insert(hash_minsn(*cand)).second )
+  {
+    msg("goomba: duplicate candidate, skipping\n");
+    delete cand;
+    return false;
+  }
+  entries.push_back({ cand, score_complexity(*cand) });
+  return true;
 }
 
 //--------------------------------------------------------------------------
-bool optimizer_t::optimize_insn(minsn_t *insn)
+void candidate_pool_t::rank()
 {
-  if ( insn->has_side_effects(true) )
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const entry_t &a, const entry_t &b) { return a.score < b.score; });
+}
+
+//--------------------------------------------------------------------------
+void candidate_pool_t::clear()
+{
+  for ( entry_t &e : entries )
+    delete e.insn;
+  entries.clear();
+}
+
+//--------------------------------------------------------------------------
+static const char *const engine_names[] =
+{
+  "Equiv class",
+  "Linear",
+  "Lin conj",
+  "Non-linear",
+};
+CASSERT(qnumber(engine_names) == ENG_COUNT);
+
+//--------------------------------------------------------------------------
+// orders the engines by their expected cost, counted in evaluations of the
+// expression, divided by the chance that they find a valid candidate.
+// the linear engines are cheap and exact for linear MBAs, but rarely help
+// with products of variables. the cost of the oracle depends on the number
+// of fingerprints, which grows with the number of variable permutations.
+void optimizer_t::plan_engines(engine_plan_t *plan, const mba_features_t &f) const
+{
+  int nvars = qmin(f.nvars, 20);
+  int nops = f.bool_cnt + f.arith_cnt;
+  double cost[ENG_COUNT];
+  cost[ENG_LINEAR] = (nvars + 1) / (f.nonlinear ? 0.05 : 0.5);
+  cost[ENG_LIN_CONJ] = (1 << nvars) / (f.nonlinear ? 0.05 : 0.9);
+  cost[ENG_NONLIN] = double(nops) * f.depth / (f.nonlinear ? 0.8 : 0.3);
+  cost[ENG_ORACLE] = 0;
+  if ( equiv_classes != nullptr )
   {
-    // msg("goomba: instruction has side effects, skipping\n");
-    return false;
+    int nperms = 1;
+    for ( int i = 2; i <= nvars && nperms < EQUIV_CLASS_MAX_FINGERPRINTS; i++ )
+      nperms *= i;
+    nperms = qmin(nperms, EQUIV_CLASS_MAX_FINGERPRINTS);
+    cost[ENG_ORACLE] = double(nperms) * equiv_classes->testcases.size() / 0.5;
   }
 
-  if ( !is_mba(*insn) )
-    return false; // not an MBA instruction
-  msg("goomba: found an MBA instruction %s\n", insn->dstr());
+  plan->clear();
+  for ( int e = 0; e < ENG_COUNT; e++ )
+    if ( e != ENG_ORACLE || equiv_classes != nullptr )
+      plan->push_back(mba_engine_t(e));
+  std::stable_sort(plan->begin(), plan->end(),
+                   [&cost](mba_engine_t a, mba_engine_t b) { return cost[a] < cost[b]; });
+}
+
+//--------------------------------------------------------------------------
+void optimizer_t::run_engine(candidate_pool_t *pool, mba_engine_t engine, const minsn_t &insn)
+{
+  switch ( engine )
+  {
+    case ENG_ORACLE:
+      { // Find candidates from the oracle file
+        minsnptrs_t tmp;
+        equiv_classes->find_candidates(&tmp, insn);
+        for ( minsn_t *i : tmp )
+          pool->add(i, "Oracle");
+      }
+      break;
+    case ENG_LINEAR:
+      { // Produce one candidate using naive linear guess
+        linear_expr_t linear_guess(insn);
+        pool->add(linear_guess.to_minsn(insn.ea), "Linear");
+      }
+      break;
+    case ENG_LIN_CONJ:
+      { // Produce one candidate using SiMBA's algorithm
+        lin_conj_expr_t lin_conj_guess(insn);      // MBA Solver's simplification
+        simp_lin_conj_expr_t simp_lin_conj_expr(lin_conj_guess);      // Simba's simplification
+        pool->add(simp_lin_conj_expr.to_minsn(insn.ea), "Simplified lin conj");
+      }
+      break;
+    case ENG_NONLIN:
+      { // Produce one candidate using non-linear MBA simplification
+        nonlin_expr_t nonlin_guess(insn);
+        if ( nonlin_guess.success() )
+          pool->add(nonlin_guess.to_minsn(insn.ea), "Non-linear");
+      }
+      break;
+    default:
+      INTERR(30828);
+  }
+}
 
-  bool success = false;
-  auto start_time = std::chrono::high_resolution_clock::now();
-  minsnptrs_t candidates;
-  try
+//--------------------------------------------------------------------------
+// creates the default query and those of the portfolio
+void optimizer_t::make_queries(smt_queries_t *queries, const minsn_t &insn)
+{
+  queries->push_back(new smt_query_t(smt_strategy_t()));
+  for ( size_t i = 0; i < portfolio.size() && i < portfolio_size; i++ )
   {
-    auto equiv_class_start = std::chrono::high_resolution_clock::now();
-    if ( equiv_classes != nullptr )
-    { // Find candidates from the oracle file
-      minsnptrs_t tmp;
-      equiv_classes->find_candidates(&tmp, *insn);
-      for ( minsn_t *i : tmp )
-        add_candidate(&candidates, i, "Oracle");
+    const smt_strategy_t &st = portfolio[i];
+    if ( st.tactics.empty() && st.seed == 0 && !st.narrow )
+      continue; // the same as the default query
+    try
+    {
+      queries->push_back(new smt_query_t(st));
     }
-    auto equiv_class_end = std::chrono::high_resolution_clock::now();
+    catch ( const z3::exception &e )
+    {
+      msg("goomba: portfolio strategy '%s': %s\n", st.tactics.c_str(), e.msg());
+    }
+  }
+  for ( smt_query_t *q : *queries )
+  {
+    if ( processes.enabled() )
+      q->processes = &processes;
+    q->set_original(insn);
+  }
+}
 
-    // Produce one candidate using naive linear guess
-    auto linear_start = equiv_class_end;
-    linear_expr_t linear_guess(*insn);
-    add_candidate(&candidates, linear_guess.to_minsn(insn->ea), "Linear");
-    auto linear_end = std::chrono::high_resolution_clock::now();
+//--------------------------------------------------------------------------
+// the exact verifiers that do not need z3: the truth tables of the linear
+// expressions, then the enumeration of all the inputs of the small ones
+native_verdict_t optimizer_t::verify_natively(proof_task_t *task, const minsn_t &cand, cex_t *cex)
+{
+  const minsn_t &insn = *task->insn;
+  if ( task->verifier == nullptr )
+    task->verifier = new linear_verifier_t(insn);
+  native_verdict_t verdict = task->verifier->verify(cand, cex);
+  if ( verdict == NV_UNKNOWN && exhaustive_bits != 0 )
+  {
+    if ( task->exhaustive == nullptr )
+      task->exhaustive = new exhaustive_verifier_t(insn, exhaustive_bits);
+    verdict = task->exhaustive->verify(cand, cex);
+  }
+  return verdict;
+}
 
-    // Produce one candidate using SiMBA's algorithm
-    auto lin_conj_start = linear_end;
-    lin_conj_expr_t lin_conj_guess(*insn);      // MBA Solver's simplification
-    simp_lin_conj_expr_t simp_lin_conj_expr(lin_conj_guess);      // Simba's simplification
-    add_candidate(&candidates, simp_lin_conj_expr.to_minsn(insn->ea), "Simplified lin conj");
-    auto lin_conj_end = std::chrono::high_resolution_clock::now();
+//--------------------------------------------------------------------------
+// runs the next engines of the plan until some candidates pass the tests,
+// and prepares their proofs. the candidates of the previous engines are
+// discarded: they were refuted. returns false if the plan is exhausted.
+bool optimizer_t::generate_candidates(proof_task_t *task)
+{
+  const minsn_t &insn = *task->insn;
+  minsnptrs_t &candidates = task->candidates;
+  for ( minsn_t *cand : candidates )
+    delete cand;
+  candidates.clear();
+  task->verified = -1;
+  for ( smt_query_t *q : task->queries )
+    q->clear_candidates();
 
-    // Produce one candidate using non-linear MBA simplification
-    auto nonlin_start = lin_conj_end;
-    nonlin_expr_t nonlin_guess(*insn);
-    if ( nonlin_guess.success() )
+  int original_score = score_complexity(insn);
+  while ( candidates.empty() && task->next_engine < task->plan.size() )
+  {
+    if ( should_stop() )
+      return false;
+    mba_engine_t engine = task->plan[task->next_engine++];
+    engine_stats_t &stats = engine_stats[engine];
+    auto start = std::chrono::high_resolution_clock::now();
+    try
     {
-      add_candidate(&candidates, nonlin_guess.to_minsn(insn->ea), "Non-linear");
+      run_engine(&task->pool, engine, insn);
     }
-    auto nonlin_end = std::chrono::high_resolution_clock::now();
+    catch ( const vd_failure_t &vf )
+    {
+      msg("goomba: %s\n", vf.hf.str.c_str());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    int64 usecs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    stats.nruns++;
+    stats.usecs += usecs;
+    task->perf.cat_sprnt("goomba: %s time: %d %" FMT_64 "d us\n", engine_names[engine], task->nvars, usecs);
 
-    // Verify the candidates. Return the simplest one that passed verification.
-    std::sort(candidates.begin(), candidates.end(), minsn_complexity_cmptr_t());
-    for ( minsn_t *cand : candidates )
+    // Keep the candidates that pass the tests, the simplest first
+    candidate_pool_t &pool = task->pool;
+    pool.rank();
+    for ( candidate_pool_t::entry_t &e : pool.entries )
     {
-      if ( check_and_substitute(insn, cand, z3_timeout, z3_assume_timeouts_correct) )
+      minsn_t *cand = e.insn;
+      msg("goomba: testing candidate: %s\n", cand->dstr());
+      if ( e.score > original_score )
       {
-        if ( qgetenv("VD_MBA_LOG_PERF") )
-        {
-          int nvars = get_input_mops(*insn).size();
-          msg("goomba: Equiv class time: %d %" FMT_64 "d us\n", nvars,
-            std::chrono::duration_cast<std::chrono::microseconds>(equiv_class_end - equiv_class_start).count());
-          msg("goomba: Linear time: %d %" FMT_64 "d us\n", nvars,
-            std::chrono::duration_cast<std::chrono::microseconds>(linear_end - linear_start).count());
-          msg("goomba: Lin conj time: %d %" FMT_64 "d us\n", nvars,
-            std::chrono::duration_cast<std::chrono::microseconds>(lin_conj_end - lin_conj_start).count());
-          msg("goomba: Non-linear time: %d %" FMT_64 "d us\n", nvars,
-            std::chrono::duration_cast<std::chrono::microseconds>(nonlin_end - nonlin_start).count());
-        }
-        success = true;
+        msg("goomba: candidate (%d) is not simpler than original (%d), skipping\n", e.score, original_score);
+        continue;
+      }
+      if ( task->battery == nullptr )
+        task->battery = new test_battery_t(insn, &cex_store.get());
+      if ( !task->battery->passes(*cand) )
+      {
+        msg("goomba: candidate not equivalent, skipping\n");
+        continue;
+      }
+      cex_t cex;
+      native_verdict_t verdict = verify_natively(task, *cand, &cex);
+      if ( verdict == NV_DIFFERENT )
+      {
+        msg("goomba: candidate refuted without z3, skipping\n");
+        cex_store.add(cex);
+        continue;
+      }
+      msg("goomba: instruction is probably equivalent to candidate\n");
+      candidates.push_back(cand);
+      e.insn = nullptr; // owned by the task now
+      if ( verdict == NV_EQUIVALENT )
+      {
+        // the more complex candidates are not needed
+        msg("goomba: candidate proved without z3\n");
+        task->verified = candidates.size() - 1;
         break;
       }
     }
+    pool.clear();
+    if ( !candidates.empty() )
+    {
+      stats.nfound++;
+      task->source = engine_names[engine];
+    }
   }
-  catch ( const vd_failure_t &vf )
+  if ( candidates.empty() )
+    return false;
+
+  // the simplest candidate needs no z3 proof if the verifier proved it
+  if ( !skip_proofs() && z3_timeout != 0 && task->verified != 0 )
   {
-    msg("goomba: %s\n", vf.hf.str.c_str());
+    if ( task->queries.empty() )
+      make_queries(&task->queries, insn);
+    for ( smt_query_t *q : task->queries )
+      for ( minsn_t *cand : candidates )
+        q->add_candidate(*cand);
+    task->timeout = get_z3_timeout();
+    task->timeout_cut = task->timeout < z3_timeout;
   }
+  return true;
+}
 
-  // delete all candidates
-  for ( minsn_t *cand : candidates )
-    delete cand;
+//--------------------------------------------------------------------------
+void optimizer_t::print_engine_stats()
+{
+  for ( int e = 0; e < ENG_COUNT; e++ )
+  {
+    engine_stats_t &stats = engine_stats[e];
+    if ( stats.nruns != 0 )
+      msg("goomba: %s: %d runs, %d with candidates, %d accepted, %" FMT_64 "d us\n",
+          engine_names[e], stats.nruns, stats.nfound, stats.nwins, stats.usecs);
+    stats = engine_stats_t();
+  }
+}
 
-  if ( success )
+//--------------------------------------------------------------------------
+void optimizer_t::add_result(
+        const minsn_t &orig,
+        uint64 hash,
+        const minsn_t *result,
+        bool proved,
+        bool interrupted)
+{
+  // an interrupted search does not mean the engines failed
+  if ( result != nullptr || (!stopped && !interrupted) )
   {
-    auto end_time = std::chrono::high_resolution_clock::now();
-    msg("goomba: Time taken: %" FMT_64 "d us\n",
-      std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count());
+    cache.add(orig, hash, result);
+    store.add(orig, hash, result);
   }
-  return success;
+  if ( result != nullptr )
+    cache.add_template(orig, *result);
+  if ( proved )
+    shared_store.add(orig, *result);
+}
+
+//--------------------------------------------------------------------------
+// looks for a known result and runs the engines on the instruction.
+// returns the task that proves the candidates, or nullptr if there is
+// nothing to prove. in the latter case, *simplified tells whether the
+// instruction was replaced by a known or unproven result.
+proof_task_t *optimizer_t::prepare_insn(minsn_t *insn, bool *simplified)
+{
+  *simplified = false;
+  if ( insn->has_side_effects(true) )
+  {
+    // msg("goomba: instruction has side effects, skipping\n");
+    return nullptr;
+  }
+
+  if ( !is_mba(*insn) )
+    return nullptr; // not an MBA instruction
+
+  uint64 hash = hash_minsn(*insn);
+  const insn_cache_entry_t *ce = cache.find(*insn, hash);
+  if ( ce != nullptr )
+  {
+    cache.nhits++;
+    if ( ce->result == nullptr )
+      return nullptr; // all engines already failed on this expression
+    msg("goomba: reusing cached result for %s\n", insn->dstr());
+    minsn_t *cached = new minsn_t(*ce->result);
+    cached->setaddr(insn->ea);
+    substitute(insn, cached);
+    delete cached;
+    *simplified = true;
+    return nullptr;
+  }
+
+  minsn_t *instance = cache.instantiate(*insn);
+  if ( instance != nullptr )
+  {
+    msg("goomba: reusing the result of an identical expression for %s\n", insn->dstr());
+    cache.add(*insn, hash, instance);
+    store.add(*insn, hash, instance);
+    substitute(insn, instance);
+    delete instance;
+    *simplified = true;
+    return nullptr;
+  }
+
+  minsn_t *stored = nullptr;
+  int code = store.find(&stored, *insn, hash);
+  if ( code >= 0 )
+  {
+    cache.add(*insn, hash, stored);
+    if ( stored == nullptr )
+      return nullptr; // failed when the function was decompiled before
+    msg("goomba: reusing stored result for %s\n", insn->dstr());
+    cache.add_template(*insn, *stored);
+    substitute(insn, stored);
+    delete stored;
+    *simplified = true;
+    return nullptr;
+  }
+
+  minsn_t *shared = shared_store.find(*insn);
+  if ( shared != nullptr )
+  {
+    msg("goomba: reusing shared result for %s\n", insn->dstr());
+    cache.add(*insn, hash, shared);
+    store.add(*insn, hash, shared);
+    cache.add_template(*insn, *shared);
+    substitute(insn, shared);
+    delete shared;
+    *simplified = true;
+    return nullptr;
+  }
+
+  if ( should_stop() )
+    return nullptr;
+
+  msg("goomba: found an MBA instruction %s\n", insn->dstr());
+  proof_task_t *task = new proof_task_t(insn, hash);
+  task->start_time = std::chrono::high_resolution_clock::now();
+  mba_features_t features = get_mba_features(*insn);
+  task->nvars = features.nvars;
+  plan_engines(&task->plan, features);
+  if ( generate_candidates(task) )
+  {
+    if ( task->verified == 0 || (!skip_proofs() && z3_timeout != 0) )
+      return task;
+    set_cmt(insn->ea, "goomba: z3 proof skipped, simplification assumed correct");
+    msg("goomba: SUCCESS: %s\n", task->candidates[0]->dstr());
+    engine_stats[task->plan[task->next_engine - 1]].nwins++;
+    substitute(insn, task->candidates[0]);
+    *simplified = true;
+  }
+  add_result(task->orig, hash, *simplified ? insn : nullptr, false, false);
+  delete task;
+  return nullptr;
+}
+
+//--------------------------------------------------------------------------
+bool optimizer_t::optimize_insn(minsn_t *insn)
+{
+  bool simplified;
+  proof_task_t *task = prepare_insn(insn, &simplified);
+  if ( task == nullptr )
+    return simplified;
+  proof_tasks_t tasks;
+  tasks.push_back(task);
+  run_tasks(tasks);
+  return finish_insn(task);
+}
+
+//--------------------------------------------------------------------------
+// the engines run on the main thread. the proofs run on the worker threads,
+// for up to MAX_PENDING_PROOFS_PER_THREAD instructions per thread at a time.
+int optimizer_t::optimize_insns(boolvec_t *simplified, const minsnptrs_t &insns)
+{
+  simplified->resize(insns.size());
+  std::fill(simplified->begin(), simplified->end(), false);
+
+  size_t max_pending = MAX_PENDING_PROOFS_PER_THREAD * get_nthreads();
+  proof_tasks_t tasks;
+  sizevec_t owners;   // indexes of the instructions of the tasks
+  sizevec_t deferred; // identical to an instruction being proved
+  std::set<uint64> pending;
+  for ( size_t i = 0; i <= insns.size(); i++ )
+  {
+    if ( tasks.size() >= max_pending || (i == insns.size() && !tasks.empty()) )
+    {
+      run_tasks(tasks);
+      for ( size_t k = 0; k < tasks.size(); k++ )
+        (*simplified)[owners[k]] = finish_insn(tasks[k]);
+      tasks.clear();
+      owners.clear();
+      pending.clear();
+      // the results of the identical instructions are in the cache now
+      for ( size_t j : deferred )
+        (*simplified)[j] = optimize_insn(insns[j]);
+      deferred.clear();
+    }
+    if ( i == insns.size() )
+      break;
+    if ( should_stop() )
+    {
+      // the prepared tasks are not proved, but they must be finished:
+      // this applies the candidates proved without z3 and deletes them
+      for ( size_t k = 0; k < tasks.size(); k++ )
+      {
+        tasks[k]->give_up();
+        (*simplified)[owners[k]] = finish_insn(tasks[k]);
+      }
+      // only the cached results are used from now on
+      for ( size_t j : deferred )
+        (*simplified)[j] = optimize_insn(insns[j]);
+      break;
+    }
+
+    minsn_t *insn = insns[i];
+    if ( pending.find(hash_minsn(*insn)) != pending.end() )
+    {
+      deferred.push_back(i);
+      continue;
+    }
+    bool ok;
+    proof_task_t *task = prepare_insn(insn, &ok);
+    if ( task == nullptr )
+    {
+      (*simplified)[i] = ok;
+      continue;
+    }
+    tasks.push_back(task);
+    owners.push_back(i);
+    pending.insert(task->hash);
+  }
+  return std::count(simplified->begin(), simplified->end(), true);
 }
@@ -8,12 +8,28 @@
 
 #pragma once
 
+#include <chrono>
+#include <atomic>
+#include <set>
+
 #include "equiv_class.hpp"
 #include "smt_convert.hpp"
 #include "heuristics.hpp"
 #include "lin_conj_exprs.hpp"
 #include "simp_lin_conj_exprs.hpp"
 #include "nonlin_expr.hpp"
+#include "insn_cache.hpp"
+#include "idb_store.hpp"
+#include "shared_store.hpp"
+#include "cex_store.hpp"
+#include "portfolio.hpp"
+#include "lin_verify.hpp"
+#include "exhaustive.hpp"
+
+// how often a running z3 check looks at the deadline and the cancel button, ms
+const int SOLVER_POLL_INTERVAL = 50;
+// how many instructions per thread are prepared before their proofs start
+const int MAX_PENDING_PROOFS_PER_THREAD = 4;
 
 //--------------------------------------------------------------------------
 inline void substitute(minsn_t *insn, minsn_t *cand)
@@ -22,13 +38,160 @@ inline void substitute(minsn_t *insn, minsn_t *cand)
   insn->swap(*cand);
 }
 
+//--------------------------------------------------------------------------
+// the engines that produce candidates
+enum mba_engine_t
+{
+  ENG_ORACLE,     // equivalence classes from the oracle file
+  ENG_LINEAR,     // naive linear guess
+  ENG_LIN_CONJ,   // SiMBA's linear MBA simplification
+  ENG_NONLIN,     // non-linear MBA simplification
+  ENG_COUNT,
+};
+typedef qvector<mba_engine_t> engine_plan_t;
+
+//--------------------------------------------------------------------------
+struct engine_stats_t
+{
+  int nruns = 0;    // number of runs, including the failed ones
+  int nfound = 0;   // runs that produced candidates passing the tests
+  int nwins = 0;    // runs whose candidate was accepted
+  int64 usecs = 0;  // total time of the runs
+};
+
+//--------------------------------------------------------------------------
+// the candidates of an instruction. the cost and the structural hash of
+// a candidate are computed once, when it is added; exact duplicates, also
+// of the candidates produced by the engines that ran before, are dropped.
+struct candidate_pool_t
+{
+  struct entry_t
+  {
+    minsn_t *insn;
+    int score;
+  };
+  qvector<entry_t> entries;   // the simplest first after rank()
+  std::set<uint64> seen;      // hashes of all candidates ever added
+
+  ~candidate_pool_t() { clear(); }
+  bool add(minsn_t *cand, const char *source); // takes ownership
+  void rank();
+  void clear(); // deletes the entries, they stay in 'seen'
+};
+
+//--------------------------------------------------------------------------
+// the proof of an MBA instruction. the instruction and its candidates are
+// converted into the z3 contexts of the task on the main thread; the proof
+// itself does not touch the microcode and may run on a worker thread.
+// TODO: only the z3 proofs run in parallel. the linear, lin-conj, nonlinear
+// and oracle engines stay on the main thread: they build minsn_t objects
+// through the decompiler and use shared state (bw_expr_tbl_t::instance,
+// default_mops_t::get_instance(), the static buffers of dstr(), rand()).
+// moving them to the workers needs a standalone expression IR for the
+// engines and the emulator, converted back to microcode on the main thread.
+// with a portfolio, each query has its own context and strategy, they race
+// on each candidate and the first definite answer wins.
+struct proof_task_t
+{
+  minsn_t *insn;              // the instruction in the microcode
+  minsn_t orig;               // its copy, insn is replaced when simplified
+  uint64 hash;
+  engine_plan_t plan;         // the engines to try, in this order
+  size_t next_engine = 0;     // the first engine of the plan that did not run
+  int nvars = 0;
+  candidate_pool_t pool;
+  test_battery_t *battery = nullptr; // created for the first candidate
+  linear_verifier_t *verifier = nullptr; // created for the first candidate
+  exhaustive_verifier_t *exhaustive = nullptr; // when the verifier cannot decide
+  int verified = -1;          // the candidate proved without z3, if any
+  minsnptrs_t candidates;     // passed the tests, the simplest first
+  smt_queries_t queries;      // the default one and the portfolio
+  uint timeout = 0;           // for each check, ms
+  bool timeout_cut = false;   // shorter than MBA_Z3_TIMEOUT, by the time budget
+  std::atomic<bool> interrupted; // set by the main thread when the time is up
+  std::chrono::high_resolution_clock::time_point start_time;
+  qstring perf;               // engine times, for VD_MBA_LOG_PERF
+  const char *source = nullptr; // the engine of the candidates
+
+  // a z3 check that ran, for MBA_SMT_CAPTURE_DIR
+  struct check_record_t
+  {
+    size_t cand;
+    size_t query;
+    z3::check_result res;
+    int64 usecs;
+  };
+
+  // the results
+  int result = -1;            // index of the accepted candidate
+  bool proved = false;        // the accepted candidate was proved, not assumed
+  qstring log;                // messages, printed by the main thread
+  cexes_t cexes;              // the inputs that refuted candidates
+  qvector<check_record_t> checks; // of the last prove()
+
+  proof_task_t(minsn_t *_insn, uint64 _hash)
+    : insn(_insn), orig(*_insn), hash(_hash), interrupted(false) {}
+  ~proof_task_t()
+  {
+    for ( minsn_t *cand : candidates )
+      delete cand;
+    for ( smt_query_t *q : queries )
+      delete q;
+    delete battery;
+    delete verifier;
+    delete exhaustive;
+  }
+  void prove(bool assume_timeouts_correct);
+  void interrupt(); // stops the proof for good, called by the main thread
+  void give_up();   // ends the proof without z3, only 'verified' is accepted
+};
+typedef qvector<proof_task_t *> proof_tasks_t;
+
 //--------------------------------------------------------------------------
 class optimizer_t
 {
+  std::chrono::steady_clock::time_point deadline;
+
+  uint get_z3_timeout() const; // z3_timeout, limited by the time left
+  void add_result(const minsn_t &orig, uint64 hash, const minsn_t *result, bool proved, bool interrupted);
+  void plan_engines(engine_plan_t *plan, const mba_features_t &f) const;
+  void run_engine(candidate_pool_t *pool, mba_engine_t engine, const minsn_t &insn);
+  void make_queries(smt_queries_t *queries, const minsn_t &insn);
+  native_verdict_t verify_natively(proof_task_t *task, const minsn_t &cand, cex_t *cex);
+  bool generate_candidates(proof_task_t *task);
+  proof_task_t *prepare_insn(minsn_t *insn, bool *simplified);
+  void run_tasks(const proof_tasks_t &tasks);
+  bool finish_insn(proof_task_t *task);
+  void capture_checks(const proof_task_t *task);
+
 public:
   uint z3_timeout = 1000;
+  uint func_time_budget = 0; // ms for all instructions of a function, 0 means no limit
+  uint budget = 0;           // of the current function, see start()
+  bool cancellable = false;  // a wait box is displayed, the user may cancel
+  bool stopped = false;      // the time budget ran out or the user cancelled
   bool z3_assume_timeouts_correct = true;
+  uint nthreads = 0;         // threads for the z3 proofs, 0 means one per core
+  int exhaustive_bits = EXH_DEFAULT_INPUT_BITS; // see MBA_EXHAUSTIVE_BITS
+  smt_strategies_t portfolio; // strategies that race on each query, see MBA_PORTFOLIO
+  smt_process_pool_t processes; // out-of-process z3, see MBA_Z3_PATH
+  qstring capture_dir;        // the z3 checks are saved there, see MBA_SMT_CAPTURE_DIR
+  uint portfolio_size = 0;    // how many of them are used, 0 disables the portfolio
+  uint64 pass_settings = 0;   // the settings of the caller that affect the results, see settings_signature()
   equiv_class_finder_t *equiv_classes = nullptr;
+  insn_cache_t cache; // results for the current mba, see insn_cache.hpp
+  idb_store_t store;  // results persisted in the database, see idb_store.hpp
+  shared_store_t shared_store; // proven results shared by all databases, see shared_store.hpp
+  engine_stats_t engine_stats[ENG_COUNT];
+  cex_store_t cex_store; // inputs that refuted candidates before, see cex_store.hpp
+  // prepares the caches and the deadline for optimizing the microcode.
+  // 'max_budget' limits func_time_budget, 0 means no limit.
+  void start(const mba_t *mba, uint max_budget = 0);
+  bool should_stop(); // checks the deadline and the cancel button
+  uint64 settings_signature() const; // identifies the settings that affect the results
+  uint get_nthreads() const;
+  void print_engine_stats(); // prints and resets engine_stats
   bool optimize_insn(minsn_t *insn); // attempts to replace the instruction with a simpler version
   bool optimize_insn_recurse(minsn_t *insn); // attempts to optimize the instruction, and if it fails, optimizes its subinstructions
+  int optimize_insns(boolvec_t *simplified, const minsnptrs_t &insns); // optimize_insn() for several instructions, the proofs run in parallel
 };
@@ -0,0 +1,386 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include <chrono>
+
+#include "z3++_no_warn.h"
+#include "portfolio.hpp"
+#include "heuristics.hpp"
+
+//-------------------------------------------------------------------------
+bool parse_smt_strategies(smt_strategies_t *out, const char *spec, qstring *errbuf)
+{
+  out->clear();
+  qstring items(spec);
+  char *ctx = nullptr;
+  for ( char *item = qstrtok(items.begin(), ";", &ctx);
+        item != nullptr;
+        item = qstrtok(nullptr, ";", &ctx) )
+  {
+    smt_strategy_t st;
+    bool empty = true;
+    char *ctx2 = nullptr;
+    for ( char *word = qstrtok(item, " \t", &ctx2);
+          word != nullptr;
+          word = qstrtok(nullptr, " \t", &ctx2) )
+    {
+      empty = false;
+      if ( strneq(word, "seed=", 5) )
+        st.seed = atoi(word + 5);
+      else if ( streq(word, "narrow") )
+        st.narrow = true;
+      else if ( streq(word, "default") )
+        st.tactics.clear();
+      else if ( st.tactics.empty() )
+        st.tactics = word;
+      else
+      {
+        errbuf->sprnt("unexpected '%s' after the tactics '%s'", word, st.tactics.c_str());
+        return false;
+      }
+    }
+    if ( !empty )
+      out->push_back(st);
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+qstring smt_strategy_t::dstr() const
+{
+  qstring res;
+  res.sprnt("%s%s seed=%u", narrow ? "narrow " : "",
+            tactics.empty() ? "default" : tactics.c_str(), seed);
+  return res;
+}
+
+//-------------------------------------------------------------------------
+static z3::solver make_solver(z3::context &ctx, const smt_strategy_t &st)
+{
+  if ( st.tactics.empty() )
+  {
+    z3::solver s(ctx);
+    if ( st.seed != 0 )
+      s.set("random_seed", st.seed);
+    return s;
+  }
+
+  qstring names(st.tactics);
+  char *tokctx = nullptr;
+  char *name = qstrtok(names.begin(), ",", &tokctx);
+  z3::tactic t(ctx, name);
+  while ( (name = qstrtok(nullptr, ",", &tokctx)) != nullptr )
+    t = t & z3::tactic(ctx, name);
+  if ( st.seed != 0 )
+  {
+    z3::params p(ctx);
+    p.set("random_seed", st.seed);
+    t = z3::with(t, p);
+  }
+  return t.mk_solver();
+}
+
+//-------------------------------------------------------------------------
+smt_query_t::smt_query_t(const smt_strategy_t &st)
+  : strategy(st),
+    solver(make_solver(converter.context, st)),
+    orig_var(converter.context),
+    facts(converter.context),
+    cand_exprs(converter.context),
+    cand_limits(converter.context),
+    vars(converter.context),
+    running(nullptr),
+    running_serial(0)
+{
+}
+
+//-------------------------------------------------------------------------
+void smt_query_t::set_original(const minsn_t &insn)
+{
+  has_original = true;
+  var_mops = get_input_mops_by_occurrence(insn);
+  converter.set_inputs(var_mops);
+  z3::expr ie = converter.minsn_to_expr(insn);
+  orig_var = converter.context.bv_const("orig", ie.get_sort().bv_size());
+  facts.push_back(orig_var == ie);
+  // the bits of overlapping variables are shared, they cannot be limited
+  if ( !have_overlapping_mops(var_mops) )
+    get_demanded_widths(&orig_widths, insn);
+  for ( const mop_t &var : var_mops )
+  {
+    z3::expr v = converter.lookup(var);
+    vars.push_back(v);
+    // a counterexample with small inputs is a counterexample all the same
+    if ( strategy.narrow && v.get_sort().bv_size() > 8 )
+      facts.push_back(z3::ult(v, converter.context.bv_val(256, v.get_sort().bv_size())));
+  }
+  for ( unsigned j = 0; j < facts.size(); j++ )
+    solver.add(facts[j]);
+}
+
+//-------------------------------------------------------------------------
+// the bits of the variables that neither the original nor the candidate
+// demand cannot tell them apart, so they are fixed to zero. z3 turns them
+// into constants before the bit-blasting.
+void smt_query_t::add_candidate(const minsn_t &cand)
+{
+  cand_exprs.push_back(converter.minsn_to_expr(cand));
+  z3::expr limit = converter.context.bool_val(true);
+  if ( !orig_widths.empty() )
+  {
+    var_widths_t cand_widths;
+    get_demanded_widths(&cand_widths, cand);
+    for ( size_t j = 0; j < var_mops.size(); j++ )
+    {
+      int size = var_mops[j].size * 8;
+      int width = qmax(get_demanded_width(orig_widths, var_mops[j]),
+                       get_demanded_width(cand_widths, var_mops[j]));
+      if ( width < size )
+        limit = limit && vars[int(j)].extract(size - 1, width) == converter.context.bv_val(0, size - width);
+    }
+  }
+  cand_limits.push_back(limit);
+}
+
+//-------------------------------------------------------------------------
+void smt_query_t::log_result(qstring *log, size_t i, z3::check_result res, int64 usecs) const
+{
+  log->cat_sprnt("goomba: SMT check result for candidate %" FMT_Z ": %d, %" FMT_64 "d us", i, res, usecs);
+  if ( !strategy.tactics.empty() || strategy.seed != 0 || strategy.narrow )
+    log->cat_sprnt(" (%s)", strategy.dstr().c_str());
+  if ( processes != nullptr )
+    log->append(" in a z3 process");
+  log->append('\n');
+}
+
+//-------------------------------------------------------------------------
+z3::check_result smt_query_t::check(
+        size_t i,
+        uint timeout,
+        cex_t *cex,
+        qstring *log,
+        bool *failed)
+{
+  if ( processes != nullptr )
+    return check_remote(i, timeout, cex, log, failed);
+
+  z3::check_result res = z3::check_result::unknown;
+  bool pushed = false;
+  try
+  {
+    solver.set("timeout", timeout);
+    solver.push();
+    pushed = true;
+    solver.add(cand_exprs[int(i)] != orig_var);
+    solver.add(cand_limits[int(i)]);
+    auto start = std::chrono::high_resolution_clock::now();
+    res = solver.check();
+    auto end = std::chrono::high_resolution_clock::now();
+    log_result(log, i, res, std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    if ( res == z3::check_result::sat )
+    {
+      log->append("Satisfiable. Counterexample: \n");
+      z3::model m = solver.get_model();
+      for ( unsigned j = 0; j < m.size(); j++ )
+      {
+        z3::func_decl v = m[j];
+        log->cat_sprnt("%s = %s\n", v.name().str().c_str(), m.get_const_interp(v).to_string().c_str());
+      }
+      // keep the values of the input variables to test other candidates
+      cex->clear();
+      for ( unsigned j = 0; j < vars.size(); j++ )
+      {
+        uint64_t v = 0;
+        m.eval(vars[j], true).is_numeral_u64(v);
+        cex->push_back(v);
+      }
+    }
+    pushed = false;
+    solver.pop();
+  }
+  catch ( const z3::exception &e )
+  {
+    log->cat_sprnt("goomba: z3 error: %s\n", e.msg());
+    *failed = true;
+    res = z3::check_result::unknown;
+    if ( pushed )
+      solver.pop();
+  }
+  return res;
+}
+
+//-------------------------------------------------------------------------
+// "a,b,c" => "(then a b c)"
+static qstring tactics_to_smt2(const qstring &tactics)
+{
+  if ( tactics.find(',') == qstring::npos )
+    return tactics;
+  qstring res("(then ");
+  for ( size_t i = 0; i < tactics.length(); i++ )
+    res.append(tactics[i] == ',' ? ' ' : tactics[i]);
+  res.append(')');
+  return res;
+}
+
+//-------------------------------------------------------------------------
+void smt_query_t::to_smt2(qstring *out, size_t i, uint timeout)
+{
+  z3::solver s(converter.context);
+  for ( unsigned j = 0; j < facts.size(); j++ )
+    s.add(facts[j]);
+  s.add(cand_exprs[int(i)] != orig_var);
+  s.add(cand_limits[int(i)]);
+  std::string smt2 = s.to_smt2();
+  size_t pos = smt2.rfind("(check-sat)");
+  if ( pos != std::string::npos )
+    smt2.erase(pos);
+  out->sprnt("(set-option :timeout %u)\n", timeout);
+  if ( strategy.seed != 0 )
+    out->cat_sprnt("(set-option :random-seed %u)\n", strategy.seed);
+  out->append(smt2.c_str());
+  if ( strategy.tactics.empty() )
+    out->append("(check-sat)\n");
+  else
+    out->cat_sprnt("(check-sat-using %s)\n", tactics_to_smt2(strategy.tactics).c_str());
+}
+
+//-------------------------------------------------------------------------
+// "((v0 #x0000002a) (v1 #b1))" => { 0x2a, 1 }
+static void parse_model_values(cex_t *cex, const char *ptr)
+{
+  while ( (ptr = strchr(ptr, '#')) != nullptr )
+  {
+    ptr++;
+    int base = *ptr == 'x' ? 16 : *ptr == 'b' ? 2 : 0;
+    if ( base == 0 )
+      continue;
+    char *end;
+    cex->push_back(strtoull(ptr + 1, &end, base));
+    ptr = end;
+  }
+}
+
+//-------------------------------------------------------------------------
+// the same check in a z3 process. the facts and the candidate are sent as
+// SMT-LIB text, the model is read with get-value. the process is killed
+// if it does not answer SMT_PROCESS_GRACE ms after the timeout.
+z3::check_result smt_query_t::check_remote(
+        size_t i,
+        uint timeout,
+        cex_t *cex,
+        qstring *log,
+        bool *failed)
+{
+  qstring text;
+  qstring get_value("(get-value (");
+  try
+  {
+    to_smt2(&text, i, timeout);
+    for ( unsigned j = 0; j < vars.size(); j++ )
+      get_value.cat_sprnt(" %s", vars[j].to_string().c_str());
+    get_value.append("))\n");
+  }
+  catch ( const z3::exception &e )
+  {
+    log->cat_sprnt("goomba: z3 error: %s\n", e.msg());
+    *failed = true;
+    return z3::check_result::unknown;
+  }
+
+  qstring errbuf;
+  smt_process_t *p = processes->acquire(&errbuf);
+  if ( p == nullptr )
+  {
+    log->cat_sprnt("goomba: cannot start %s: %s\n", processes->path.c_str(), errbuf.c_str());
+    *failed = true;
+    return z3::check_result::unknown;
+  }
+  uint64 serial = p->begin_query();
+  running_serial = serial;
+  running = p;
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::milliseconds(timeout + SMT_PROCESS_GRACE);
+  z3::check_result res = z3::check_result::unknown;
+  bool answered = false;
+  qstring line;
+  if ( p->send(text) )
+  {
+    while ( !answered && p->receive(&line, deadline) )
+    {
+      if ( line == "sat" )
+        res = z3::check_result::sat;
+      else if ( line == "unsat" )
+        res = z3::check_result::unsat;
+      else if ( line == "unknown" )
+        res = z3::check_result::unknown;
+      else if ( strneq(line.c_str(), "(error", 6) )
+        break;
+      else
+        continue;
+      answered = true;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  int64 usecs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+  if ( !answered )
+  {
+    if ( p->was_killed() )
+    {
+      // a timeout, whether it came from the deadline or from interrupt_check()
+      log->cat_sprnt("goomba: z3 process killed after %" FMT_64 "d us\n", usecs);
+    }
+    else
+    {
+      log->cat_sprnt("goomba: z3 process failed: %s\n", line.empty() ? "no answer" : line.c_str());
+      *failed = true;
+    }
+    p->kill(serial); // its state is unknown, a new one will be started
+  }
+  else
+  {
+    log_result(log, i, res, usecs);
+    if ( res == z3::check_result::sat )
+    {
+      // the model is printed on one or more lines, until the parens match
+      qstring model;
+      int depth = 0;
+      if ( p->send(get_value) )
+      {
+        while ( p->receive(&line, deadline) )
+        {
+          model.append(line);
+          for ( size_t k = 0; k < line.length(); k++ )
+            depth += line[k] == '(' ? 1 : line[k] == ')' ? -1 : 0;
+          if ( depth <= 0 && !model.empty() )
+            break;
+        }
+      }
+      log->cat_sprnt("Satisfiable. Counterexample: \n%s\n", model.c_str());
+      cex->clear();
+      parse_model_values(cex, model.c_str());
+      if ( cex->size() != vars.size() )
+        cex->clear();
+    }
+    p->send("(reset)\n");
+  }
+  running = nullptr;
+  processes->release(p);
+  return res;
+}
+
+//-------------------------------------------------------------------------
+void smt_query_t::interrupt_check()
+{
+  smt_process_t *p = running;
+  if ( p != nullptr )
+    processes->kill(p, running_serial);
+  else
+    Z3_solver_interrupt(converter.context, solver);
+}
@@ -0,0 +1,81 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <atomic>
+#include "smt_convert.hpp"
+#include "cex_store.hpp"
+#include "smt_process.hpp"
+#include "demanded_bits.hpp"
+
+//-------------------------------------------------------------------------
+// one way of solving the equivalence queries, see MBA_PORTFOLIO in goomba.cfg
+struct smt_strategy_t
+{
+  qstring tactics;      // comma separated z3 tactics, empty for the default solver
+  uint seed = 0;        // random seed, 0 keeps the default one
+  bool narrow = false;  // refutation only: the inputs are limited to 8 bits
+
+  qstring dstr() const; // in the syntax of MBA_PORTFOLIO
+};
+typedef qvector<smt_strategy_t> smt_strategies_t;
+
+// the items are separated by ';', each item is one of:
+//   default [seed=N]
+//   narrow
+//   tactic1,tactic2,... [seed=N]
+bool parse_smt_strategies(smt_strategies_t *out, const char *spec, qstring *errbuf);
+
+//-------------------------------------------------------------------------
+// the equivalence queries of an instruction in a z3 context of their own.
+// the expressions are converted on the main thread; the checks only use
+// the context, so they may run on any thread.
+struct smt_query_t
+{
+  smt_strategy_t strategy;
+  z3_converter_t converter;   // owns the z3 context of the query
+  z3::solver solver;          // the facts, asserted once
+  z3::expr orig_var;          // the value of the original expression
+  z3::expr_vector facts;      // orig_var == the original, and the limits
+  z3::expr_vector cand_exprs; // the converted candidates
+  z3::expr_vector cand_limits;// their high bits that do not matter are 0
+  z3::expr_vector vars;       // the input variables, by occurrence
+  mopvec_t var_mops;          // the same variables in the microcode
+  var_widths_t orig_widths;   // their demanded bits in the original
+  bool has_original = false;
+  smt_process_pool_t *processes = nullptr; // run the checks there if set
+  std::atomic<smt_process_t *> running;    // the process of the current check
+  std::atomic<uint64> running_serial;
+
+  // throws z3::exception if the strategy cannot be set up
+  smt_query_t(const smt_strategy_t &st);
+  void set_original(const minsn_t &insn);
+  void add_candidate(const minsn_t &cand);
+  void clear_candidates() { cand_exprs.resize(0); cand_limits.resize(0); }
+
+  // checks whether candidate 'i' differs from the original. the inputs of
+  // a 'sat' answer are returned in 'cex'. errors are reported as 'unknown'
+  // with *failed set. a z3 process killed at the deadline is a timeout,
+  // not an error.
+  z3::check_result check(size_t i, uint timeout, cex_t *cex, qstring *log, bool *failed);
+  z3::check_result check_remote(size_t i, uint timeout, cex_t *cex, qstring *log, bool *failed);
+  // the check of candidate 'i' as an SMT-LIB script, without the get-value.
+  // throws z3::exception.
+  void to_smt2(qstring *out, size_t i, uint timeout);
+  void log_result(qstring *log, size_t i, z3::check_result res, int64 usecs) const;
+  // a 'sat' answer is always definite, 'unsat' unless the inputs are limited
+  bool is_definite(z3::check_result res) const
+  {
+    return res == z3::check_result::sat
+        || (res == z3::check_result::unsat && !strategy.narrow);
+  }
+  // stops the running check, if any. unlike interrupting the context,
+  // this does not affect the next checks.
+  void interrupt_check();
+};
+typedef qvector<smt_query_t *> smt_queries_t;
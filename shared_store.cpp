@@ -0,0 +1,427 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "z3++_no_warn.h"
+#include <fpro.h>
+#include "shared_store.hpp"
+#include "idb_store.hpp"
+#include "insn_cache.hpp"
+#include "heuristics.hpp"
+#include "equiv_class.hpp"
+
+// the file starts with the magic, the version of the file layout, and the
+// minsn serialization format. the rest are records:
+//   uint32 SHARED_STORE_RECORD_MAGIC
+//   uint32 size of the body
+//   uint32 crc32 of the body
+//   body:
+//     uint64 key
+//     uint32 size of orig, orig bytes
+//     uint32 size of result, result bytes
+// a record torn by a crash is skipped: the readers look for the next
+// record magic whose checksum matches.
+static const char SHARED_STORE_MAGIC[4] = { 'G', 'M', 'B', 'S' };
+const uint32 SHARED_STORE_VERSION = 2;
+const uint32 SHARED_STORE_HDRSIZE = sizeof(SHARED_STORE_MAGIC) + 2 * sizeof(uint32);
+const uint32 SHARED_STORE_RECORD_MAGIC = 0x52424d47; // "GMBR"
+const uint32 SHARED_STORE_RECHDRSIZE = 3 * sizeof(uint32);
+// anything bigger is certainly garbage
+const uint32 SHARED_STORE_MAX_RECORD_SIZE = 1024 * 1024;
+// how long to wait for the instance that creates the file to write its header, ms
+const int SHARED_STORE_CREATE_WAIT = 1000;
+
+//-------------------------------------------------------------------------
+static bytevec_t make_header(uint32 format_version)
+{
+  bytevec_t hdr;
+  append_raw(&hdr, SHARED_STORE_MAGIC);
+  append_raw(&hdr, SHARED_STORE_VERSION);
+  append_raw(&hdr, format_version);
+  return hdr;
+}
+
+//-------------------------------------------------------------------------
+static bool read_header(FILE *fp, uint32 format_version)
+{
+  bytevec_t expected = make_header(format_version);
+  bytevec_t hdr;
+  hdr.resize(expected.size());
+  return qfseek(fp, 0, SEEK_SET) == 0
+      && qfread(fp, hdr.begin(), hdr.size()) == hdr.size()
+      && hdr == expected;
+}
+
+//-------------------------------------------------------------------------
+// fills the record with the canonical forms of the instruction and, if
+// specified, of its simplification
+static bool make_record(
+        shared_record_t *rec,
+        const minsn_t &insn,
+        const minsn_t *result,
+        const mopvec_t &vars)
+{
+  minsn_t *abstract = make_abstract_minsn(insn, vars);
+  if ( abstract == nullptr )
+    return false;
+  rec->key = hash_minsn(*abstract);
+  abstract->serialize(&rec->orig);
+  delete abstract;
+
+  if ( result != nullptr )
+  {
+    abstract = make_abstract_minsn(*result, vars);
+    if ( abstract == nullptr )
+      return false; // the result refers to a variable that is not an input
+    abstract->serialize(&rec->result);
+    delete abstract;
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+bool shared_store_t::open(const char *_path)
+{
+  close();
+  path = _path;
+  bytevec_t bv;
+  format_version = minsn_t(0).serialize(&bv);
+
+  if ( !qfileexist(path.c_str()) )
+  {
+    // only the instance that creates the file writes the header
+    int h = qopen(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_BINARY);
+    if ( h >= 0 )
+    {
+      bytevec_t hdr = make_header(format_version);
+      bool ok = qwrite(h, hdr.begin(), hdr.size()) == ssize_t(hdr.size());
+      qclose(h);
+      if ( !ok )
+      {
+        msg("%s: %s\n", path.c_str(), qstrerror(-1));
+        return false;
+      }
+    }
+  }
+
+  fp = qfopen(path.c_str(), "rb");
+  if ( fp == nullptr )
+  {
+    msg("%s: %s\n", path.c_str(), qstrerror(-1));
+    return false;
+  }
+  // another instance may have just created the file
+  for ( int waited = 0;
+        qfsize(fp) < SHARED_STORE_HDRSIZE && waited < SHARED_STORE_CREATE_WAIT;
+        waited += 10 )
+  {
+    qsleep(10);
+  }
+  if ( !read_header(fp, format_version) )
+  {
+    msg("%s: not a goomba store or created by another version of IDA\n", path.c_str());
+    close();
+    return false;
+  }
+  scanned = SHARED_STORE_HDRSIZE;
+  refresh();
+  return true;
+}
+
+//-------------------------------------------------------------------------
+void shared_store_t::close()
+{
+  if ( fp != nullptr )
+  {
+    qfclose(fp);
+    fp = nullptr;
+  }
+  index.clear();
+  scanned = 0;
+}
+
+//-------------------------------------------------------------------------
+// indexes the records appended since the last call
+void shared_store_t::refresh()
+{
+  if ( fp == nullptr )
+    return;
+
+  qoff64_t fsize = qfsize(fp);
+  while ( scanned + SHARED_STORE_RECHDRSIZE <= fsize )
+  {
+    shared_record_t rec;
+    qoff64_t next;
+    int code = read_record(&rec, &next, scanned, fsize);
+    if ( code == RR_INCOMPLETE )
+      break; // another instance is still writing it
+    if ( code == RR_BAD )
+    {
+      msg("%s: skipping a damaged record at offset %" FMT_64 "d\n", path.c_str(), int64(scanned));
+      scanned = find_record_magic(scanned + 1, fsize);
+      continue;
+    }
+    index.insert({ rec.key, scanned });
+    scanned = next;
+  }
+}
+
+//-------------------------------------------------------------------------
+// returns the offset of the next record magic at or after 'off'. if there
+// is none, returns the position from which a magic still being written
+// would be found.
+qoff64_t shared_store_t::find_record_magic(qoff64_t off, qoff64_t fsize) const
+{
+  const size_t MSIZE = sizeof(SHARED_STORE_RECORD_MAGIC);
+  bytevec_t buf;
+  while ( off + MSIZE <= fsize )
+  {
+    size_t n = size_t(qmin(fsize - off, qoff64_t(0x10000)));
+    buf.resize(n);
+    if ( qfseek(fp, off, SEEK_SET) != 0 || qfread(fp, buf.begin(), n) != n )
+      break;
+    for ( size_t i = 0; i + MSIZE <= n; i++ )
+    {
+      uint32 magic;
+      memcpy(&magic, &buf[i], MSIZE);
+      if ( magic == SHARED_STORE_RECORD_MAGIC )
+        return off + i;
+    }
+    off += n - (MSIZE - 1);
+  }
+  return qmax(off, fsize - qoff64_t(MSIZE - 1));
+}
+
+//-------------------------------------------------------------------------
+// reads the record at 'off'. *next receives the offset of the record after it.
+int shared_store_t::read_record(
+        shared_record_t *rec,
+        qoff64_t *next,
+        qoff64_t off,
+        qoff64_t fsize) const
+{
+  uint32 magic;
+  uint32 size;
+  uint32 crc;
+  if ( off + SHARED_STORE_RECHDRSIZE > fsize )
+    return RR_INCOMPLETE;
+  if ( qfseek(fp, off, SEEK_SET) != 0
+    || qfread(fp, &magic, sizeof(magic)) != sizeof(magic)
+    || qfread(fp, &size, sizeof(size)) != sizeof(size)
+    || qfread(fp, &crc, sizeof(crc)) != sizeof(crc) )
+  {
+    return RR_INCOMPLETE;
+  }
+  if ( magic != SHARED_STORE_RECORD_MAGIC
+    || size < sizeof(rec->key) + 2 * sizeof(uint32)
+    || size > SHARED_STORE_MAX_RECORD_SIZE )
+  {
+    return RR_BAD;
+  }
+  *next = off + SHARED_STORE_RECHDRSIZE + size;
+  if ( *next > fsize )
+    return RR_INCOMPLETE;
+  bytevec_t body;
+  body.resize(size);
+  if ( qfread(fp, body.begin(), size) != size )
+    return RR_INCOMPLETE;
+  if ( calc_crc32(0, body.begin(), size) != crc )
+    return RR_BAD;
+
+  blob_reader_t r(body);
+  uint32 orig_size;
+  uint32 result_size;
+  bool ok = r.read(&rec->key)
+         && r.read(&orig_size)
+         && r.read(&rec->orig, orig_size)
+         && r.read(&result_size)
+         && r.read(&rec->result, result_size);
+  return ok ? RR_OK : RR_BAD;
+}
+
+//-------------------------------------------------------------------------
+// reads a record found by refresh()
+bool shared_store_t::read_record(shared_record_t *rec, qoff64_t off) const
+{
+  qoff64_t next;
+  return read_record(rec, &next, off, qfsize(fp)) == RR_OK;
+}
+
+//-------------------------------------------------------------------------
+bool shared_store_t::contains(const shared_record_t &rec) const
+{
+  auto range = index.equal_range(rec.key);
+  for ( auto p = range.first; p != range.second; ++p )
+  {
+    shared_record_t known;
+    if ( read_record(&known, p->second) && known.orig == rec.orig )
+      return true;
+  }
+  return false;
+}
+
+//-------------------------------------------------------------------------
+static bytevec_t serialize_record(const shared_record_t &rec)
+{
+  bytevec_t body;
+  append_raw(&body, rec.key);
+  append_raw(&body, uint32(rec.orig.size()));
+  append_bytes(&body, rec.orig);
+  append_raw(&body, uint32(rec.result.size()));
+  append_bytes(&body, rec.result);
+
+  bytevec_t bv;
+  append_raw(&bv, SHARED_STORE_RECORD_MAGIC);
+  append_raw(&bv, uint32(body.size()));
+  append_raw(&bv, calc_crc32(0, body.begin(), body.size()));
+  append_bytes(&bv, body);
+  return bv;
+}
+
+//-------------------------------------------------------------------------
+bool shared_store_t::append(const shared_record_t &rec) const
+{
+  int h = qopen(path.c_str(), O_WRONLY | O_APPEND | O_BINARY);
+  if ( h < 0 )
+  {
+    msg("%s: %s\n", path.c_str(), qstrerror(-1));
+    return false;
+  }
+  // one unbuffered write on a descriptor in append mode: the record goes
+  // to the end of the file, after those of the other instances. a record
+  // torn anyway, e.g. by a crash, fails its checksum and is skipped.
+  bytevec_t bv = serialize_record(rec);
+  bool ok = qwrite(h, bv.begin(), bv.size()) == ssize_t(bv.size());
+  qclose(h);
+  return ok;
+}
+
+//-------------------------------------------------------------------------
+minsn_t *shared_store_t::find(const minsn_t &insn)
+{
+  if ( fp == nullptr )
+    return nullptr;
+
+  mopvec_t vars = get_input_mops_by_occurrence(insn);
+  if ( have_overlapping_mops(vars) )
+    return nullptr;
+  shared_record_t key;
+  if ( !make_record(&key, insn, nullptr, vars) )
+    return nullptr;
+
+  refresh();
+  auto range = index.equal_range(key.key);
+  for ( auto p = range.first; p != range.second; ++p )
+  {
+    shared_record_t rec;
+    if ( !read_record(&rec, p->second) || rec.orig != key.orig )
+      continue;
+    minsn_t abstract(insn.ea);
+    if ( !abstract.deserialize(rec.result.begin(), rec.result.size(), format_version) )
+      continue;
+    minsn_t *res = make_concrete_minsn(insn.ea, abstract, vars, insn.d.size);
+    if ( res == nullptr )
+      continue;
+    res->optimize_solo();
+    nhits++;
+    return res;
+  }
+  return nullptr;
+}
+
+//-------------------------------------------------------------------------
+void shared_store_t::add(const minsn_t &insn, const minsn_t &result)
+{
+  if ( fp == nullptr )
+    return;
+
+  mopvec_t vars = get_input_mops_by_occurrence(insn);
+  if ( have_overlapping_mops(vars) )
+    return; // the proof depends on how the inputs overlap
+  shared_record_t rec;
+  if ( !make_record(&rec, insn, &result, vars) )
+    return;
+
+  refresh();
+  if ( contains(rec) )
+    return;
+  if ( append(rec) )
+    refresh(); // index our own record
+}
+
+//-------------------------------------------------------------------------
+int shared_store_t::import_file(const char *src_path)
+{
+  if ( fp == nullptr )
+    return -1;
+
+  if ( !qfileexist(src_path) )
+  {
+    msg("%s: file does not exist\n", src_path);
+    return -1;
+  }
+  shared_store_t src;
+  if ( !src.open(src_path) )
+    return -1;
+
+  refresh();
+  int n = 0;
+  for ( const auto &p : src.index )
+  {
+    shared_record_t rec;
+    if ( !src.read_record(&rec, p.second) )
+      return -1;
+    if ( contains(rec) )
+      continue;
+    if ( !append(rec) )
+      return -1;
+    refresh();
+    n++;
+  }
+  return n;
+}
+
+//-------------------------------------------------------------------------
+int shared_store_t::export_file(const char *dst_path)
+{
+  if ( fp == nullptr )
+    return -1;
+
+  FILE *fout = qfopen(dst_path, "wb");
+  if ( fout == nullptr )
+  {
+    msg("%s: %s\n", dst_path, qstrerror(-1));
+    return -1;
+  }
+
+  refresh();
+  bytevec_t hdr = make_header(format_version);
+  bool ok = qfwrite(fout, hdr.begin(), hdr.size()) == hdr.size();
+  int n = 0;
+  std::multimap<uint64, bytevec_t> written; // concurrent writers may have added duplicates
+  for ( const auto &p : index )
+  {
+    shared_record_t rec;
+    if ( !ok || !read_record(&rec, p.second) )
+    {
+      ok = false;
+      break;
+    }
+    auto range = written.equal_range(rec.key);
+    if ( std::any_of(range.first, range.second,
+                     [&rec](const auto &w) { return w.second == rec.orig; }) )
+    {
+      continue;
+    }
+    bytevec_t bv = serialize_record(rec);
+    ok = qfwrite(fout, bv.begin(), bv.size()) == bv.size();
+    written.insert({ rec.key, rec.orig });
+    n++;
+  }
+  qfclose(fout);
+  return ok ? n : -1;
+}
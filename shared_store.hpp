@@ -0,0 +1,74 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <hexrays.hpp>
+
+//-------------------------------------------------------------------------
+// one simplification in canonical form: the input variables are replaced by
+// abstract mop_l's numbered in the order of their first occurrence, so the
+// same obfuscation pattern has the same canonical form in any function of
+// any database.
+struct shared_record_t
+{
+  uint64 key;       // hash_minsn() of the canonical original
+  bytevec_t orig;   // serialized canonical original, to rule out collisions
+  bytevec_t result; // serialized canonical simplification
+};
+
+//-------------------------------------------------------------------------
+// a file with proven simplifications shared by all databases.
+// the file is append-only: each record is written with a single unbuffered
+// write in append mode, so several IDA instances may use the same file at
+// once. the records have a magic and a checksum, so that the readers skip
+// a damaged one and find the next.
+// the readers keep an index of record offsets in memory and pick up the
+// records appended by other instances when the file grows.
+// only simplifications proven by z3 for instructions whose inputs do not
+// overlap are stored: for them, the canonical form is exact and the
+// simplification holds for any other instance of the same pattern.
+class shared_store_t
+{
+  qstring path;
+  FILE *fp = nullptr;                   // opened for reading
+  uint32 format_version = 0;            // minsn serialization format
+  qoff64_t scanned = 0;                 // end of the last complete record
+  std::multimap<uint64, qoff64_t> index; // key -> offset of the record
+
+  enum { RR_OK, RR_INCOMPLETE, RR_BAD };
+  void refresh();
+  qoff64_t find_record_magic(qoff64_t off, qoff64_t fsize) const;
+  int read_record(shared_record_t *rec, qoff64_t *next, qoff64_t off, qoff64_t fsize) const;
+  bool read_record(shared_record_t *rec, qoff64_t off) const;
+  bool contains(const shared_record_t &rec) const;
+  bool append(const shared_record_t &rec) const;
+
+public:
+  int nhits = 0;    // number of lookups answered by the store
+
+  ~shared_store_t() { close(); }
+
+  // opens the store, creating the file if it does not exist
+  bool open(const char *path);
+  void close();
+  bool is_open() const { return fp != nullptr; }
+  size_t size() const { return index.size(); }
+
+  // returns the concrete simplification of the instruction or nullptr
+  minsn_t *find(const minsn_t &insn);
+  // remembers a simplification proven by z3. does nothing if the instruction
+  // cannot be represented in canonical form or is already known.
+  void add(const minsn_t &insn, const minsn_t &result);
+
+  // appends the records of another store that are not known yet.
+  // returns the number of imported records, -1 on failure.
+  int import_file(const char *src_path);
+  // writes all records to a new file, without duplicates.
+  // returns the number of exported records, -1 on failure.
+  int export_file(const char *dst_path);
+};
@@ -8,6 +8,22 @@
 
 #include "z3++_no_warn.h"
 #include "smt_convert.hpp"
+#include "heuristics.hpp"
+#include "insn_cache.hpp"
+
+//--------------------------------------------------------------------------
+void z3_converter_t::set_inputs(const mopvec_t &inputs)
+{
+  whole_vars.clear();
+  for ( size_t i = 0; i < inputs.size(); i++ )
+  {
+    bool overlaps = false;
+    for ( size_t j = 0; j < inputs.size() && !overlaps; j++ )
+      overlaps = j != i && mops_overlap(inputs[i], inputs[j]);
+    if ( !overlaps )
+      whole_vars.push_back(inputs[i]);
+  }
+}
 
 //--------------------------------------------------------------------------
 z3::expr z3_converter_t::create_new_z3_var(const mop_t &mop)
@@ -29,7 +45,7 @@ z3::expr z3_converter_t::mop_to_expr(const mop_t &mop)
       }
 
     case mop_d: // result of another instruction
-      return minsn_to_expr(*mop.d);
+      return subinsn_to_expr(*mop.d);
 
     case mop_r: // register
     case mop_S: // stack variable
@@ -51,6 +67,37 @@ z3::expr z3_converter_t::mop_to_expr(const mop_t &mop)
 
 //--------------------------------------------------------------------------
 z3::expr z3_converter_t::minsn_to_expr(const minsn_t &insn)
+{
+  subtree_hashes.clear();
+  converted.clear();
+  hash_minsn_subtrees(&subtree_hashes, insn);
+  z3::expr res = subinsn_to_expr(insn);
+  // the instructions may be freed after the conversion
+  subtree_hashes.clear();
+  converted.clear();
+  return res;
+}
+
+//--------------------------------------------------------------------------
+z3::expr z3_converter_t::subinsn_to_expr(const minsn_t &insn)
+{
+  auto h = subtree_hashes.find(&insn);
+  if ( h == subtree_hashes.end() )
+    return convert_insn(insn); // not called by minsn_to_expr()
+  auto p = converted.find(h->second);
+  if ( p != converted.end() )
+  {
+    const minsn_t *prev = p->second.insn;
+    if ( prev->d.size == insn.d.size && prev->equal_insns(insn, 0) )
+      return p->second.expr;
+  }
+  z3::expr res = convert_insn(insn);
+  converted.insert( { h->second, converted_insn_t{ &insn, res } } );
+  return res;
+}
+
+//--------------------------------------------------------------------------
+z3::expr z3_converter_t::convert_insn(const minsn_t &insn)
 {
   switch ( insn.opcode )
   {
@@ -34,13 +34,33 @@ public:
 
   std::map<const mop_t, z3::expr> cache;
 
+  // the subinstructions converted so far by minsn_to_expr(), by their
+  // structural hash. obfuscated expressions repeat large subtrees, and each
+  // of them is converted only once.
+  struct converted_insn_t
+  {
+    const minsn_t *insn;  // to rule out hash collisions
+    z3::expr expr;
+  };
+  std::map<const minsn_t *, uint64> subtree_hashes;
+  std::map<uint64, converted_insn_t> converted;
+
+  // the input variables that overlap no other input. each of them is one
+  // bitvector of its full size instead of a concatenation of bytes, which
+  // gives z3 fewer variables and terms to simplify.
+  mopvec_t whole_vars;
+
   z3_converter_t() { namebuf[0] = '\0'; }
   virtual ~z3_converter_t() {}
 
+  // must be called before the conversion of an expression with 'inputs'
+  void set_inputs(const mopvec_t &inputs);
   // create_new_z3_var is called when var_to_expr fails to find an assigned_var in the cache
   virtual z3::expr create_new_z3_var(const mop_t &mop);
   z3::expr mop_to_expr(const mop_t &mop);
   z3::expr minsn_to_expr(const minsn_t &insn);
+  z3::expr subinsn_to_expr(const minsn_t &insn);
+  z3::expr convert_insn(const minsn_t &insn);
 
   //-------------------------------------------------------------------------
   z3::expr bool_to_bv(z3::expr boolean, uint bitsz)
@@ -115,6 +135,22 @@ public:
     return z3::concat(byte_exprs);
   }
 
+  //-------------------------------------------------------------------------
+  // create a bitvector for the bytes [off, off+size), unless some of them
+  // are already known. the bytes are added to the map as its slices, so a
+  // variable that overlaps it later is still converted correctly.
+  bool create_whole(z3::expr *out, uval_t off, size_t size, std::map<const uval_t, z3::expr> &map)
+  {
+    for ( size_t i = 0; i < size; i++ )
+      if ( map.find(off + i) != map.end() )
+        return false;
+    z3::expr var = context.bv_const(build_new_varname(), size * 8);
+    for ( size_t i = 0; i < size; i++ )
+      map.insert( { off + i, var.extract(i * 8 + 7, i * 8) } );
+    *out = var;
+    return true;
+  }
+
   //-------------------------------------------------------------------------
   z3::expr lookup(const mop_t &op)
   {
@@ -122,25 +158,34 @@ public:
     if ( it != cache.end() )
       return it->second;
 
-    z3::expr result(context);
+    uval_t off;
+    std::map<const uval_t, z3::expr> *map;
     switch ( op.t )
     {
       case mop_S:         // stack variable
-        result = find_update(op.s->off, op.size, stk_map);
+        off = op.s->off;
+        map = &stk_map;
         break;
       case mop_v:         // global variable
-        result = find_update(op.g, op.size, glb_map);
+        off = op.g;
+        map = &glb_map;
         break;
       case mop_l:         // local variable
-        result = find_update(op.l->off, op.size, local_map);
+        off = op.l->off;
+        map = &local_map;
         break;
       case mop_r:         // register
-        result = find_update(op.r, op.size, reg_map);
+        off = op.r;
+        map = &reg_map;
         break;
       default:
         INTERR(30821);
     }
 
+    z3::expr result(context);
+    if ( !whole_vars.has(op) || !create_whole(&result, off, op.size, *map) )
+      result = find_update(off, op.size, *map);
+
     cache.insert( { op, result } );
     return result;
   }
@@ -0,0 +1,273 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#include "smt_process.hpp"
+
+//-------------------------------------------------------------------------
+bool smt_process_t::start(const char *path, qstring *errbuf)
+{
+  qhandle_t in[2];
+  qhandle_t out[2];
+  if ( qpipe_create(in) != 0 )
+  {
+    *errbuf = qstrerror(-1);
+    return false;
+  }
+  if ( qpipe_create(out) != 0 )
+  {
+    *errbuf = qstrerror(-1);
+    qpipe_close(in[0]);
+    qpipe_close(in[1]);
+    return false;
+  }
+
+  launch_process_params_t lpp;
+  lpp.path = path;
+  lpp.args = "-in -smt2";
+  lpp.flags = LP_HIDE_WINDOW;
+  lpp.in_handle = ssize_t(in[0]);
+  lpp.out_handle = ssize_t(out[1]);
+  lpp.err_handle = ssize_t(out[1]);
+  handle = launch_process(lpp, errbuf);
+  // the ends of z3 must be closed here, so that its death ends the output
+  qpipe_close(in[0]);
+  qpipe_close(out[1]);
+  if ( handle == nullptr )
+  {
+    qpipe_close(in[1]);
+    qpipe_close(out[0]);
+    return false;
+  }
+  input = in[1];
+  output = out[0];
+  reader = std::thread(&smt_process_t::read_output, this);
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// runs on the reader thread until the process exits
+void smt_process_t::read_output()
+{
+  qstring partial;
+  char buf[4096];
+  while ( true )
+  {
+    ssize_t n = qpipe_read(output, buf, sizeof(buf));
+    if ( n <= 0 )
+      break;
+    std::lock_guard<std::mutex> lk(lock);
+    for ( ssize_t i = 0; i < n; i++ )
+    {
+      if ( buf[i] == '\n' )
+      {
+        lines.push_back(partial);
+        partial.clear();
+      }
+      else if ( buf[i] != '\r' )
+      {
+        partial.append(buf[i]);
+      }
+    }
+    cv.notify_all();
+  }
+  std::lock_guard<std::mutex> lk(lock);
+  eof = true;
+  cv.notify_all();
+}
+
+//-------------------------------------------------------------------------
+void smt_process_t::terminate()
+{
+  if ( handle == nullptr )
+    return;
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    if ( !eof && !killed )
+    {
+      term_process(handle);
+      killed = true;
+    }
+  }
+  if ( reader.joinable() )
+    reader.join();
+  qpipe_close(input);
+  qpipe_close(output);
+  int code;
+  check_process_exit(handle, &code, -1);
+  handle = nullptr;
+}
+
+//-------------------------------------------------------------------------
+bool smt_process_t::alive()
+{
+  std::lock_guard<std::mutex> lk(lock);
+  return !eof && !killed;
+}
+
+//-------------------------------------------------------------------------
+bool smt_process_t::was_killed()
+{
+  std::lock_guard<std::mutex> lk(lock);
+  return killed;
+}
+
+//-------------------------------------------------------------------------
+uint64 smt_process_t::begin_query()
+{
+  std::lock_guard<std::mutex> lk(lock);
+  lines.clear(); // the leftovers of the previous query
+  // unique among all the processes, see smt_process_pool_t::kill()
+  static std::atomic<uint64> last_serial(0);
+  serial = ++last_serial;
+  return serial;
+}
+
+//-------------------------------------------------------------------------
+bool smt_process_t::send(const qstring &text)
+{
+  if ( !alive() )
+    return false;
+  const char *ptr = text.c_str();
+  size_t size = text.length();
+  while ( size != 0 )
+  {
+    ssize_t n = qpipe_write(input, ptr, size);
+    if ( n <= 0 )
+      return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+bool smt_process_t::receive(qstring *line, std::chrono::steady_clock::time_point deadline)
+{
+  std::unique_lock<std::mutex> lk(lock);
+  if ( !cv.wait_until(lk, deadline, [this] { return !lines.empty() || eof || killed; }) )
+  {
+    // z3 ignored its own timeout
+    if ( !killed )
+    {
+      term_process(handle);
+      killed = true;
+    }
+    return false;
+  }
+  if ( lines.empty() )
+    return false;
+  line->swap(lines.front());
+  lines.erase(lines.begin());
+  return true;
+}
+
+//-------------------------------------------------------------------------
+void smt_process_t::kill(uint64 query_serial)
+{
+  std::lock_guard<std::mutex> lk(lock);
+  if ( query_serial == serial && !eof && !killed )
+  {
+    term_process(handle);
+    killed = true;
+    cv.notify_all();
+  }
+}
+
+//-------------------------------------------------------------------------
+// called with the lock held. the processes are started one at a time, so
+// that none of them inherits the pipes of another one: the output of a
+// killed process would never end otherwise.
+smt_process_t *smt_process_pool_t::spawn(qstring *errbuf)
+{
+  smt_process_t *p = new smt_process_t;
+  if ( !p->start(path.c_str(), errbuf) )
+  {
+    delete p;
+    return nullptr;
+  }
+  all.push_back(p);
+  return p;
+}
+
+//-------------------------------------------------------------------------
+// called with the lock held. reaps the process and joins its reader thread.
+void smt_process_pool_t::destroy(smt_process_t *p)
+{
+  all.del(p);
+  delete p;
+}
+
+//-------------------------------------------------------------------------
+void smt_process_pool_t::warm_up(size_t n)
+{
+  std::lock_guard<std::mutex> lk(lock);
+  while ( idle.size() < n )
+  {
+    qstring errbuf;
+    smt_process_t *p = spawn(&errbuf);
+    if ( p == nullptr )
+    {
+      msg("goomba: %s: %s\n", path.c_str(), errbuf.c_str());
+      break;
+    }
+    idle.push_back(p);
+  }
+}
+
+//-------------------------------------------------------------------------
+smt_process_t *smt_process_pool_t::acquire(qstring *errbuf)
+{
+  std::lock_guard<std::mutex> lk(lock);
+  while ( !idle.empty() )
+  {
+    smt_process_t *p = idle.back();
+    idle.pop_back();
+    if ( p->alive() )
+      return p;
+    destroy(p);
+  }
+  return spawn(errbuf);
+}
+
+//-------------------------------------------------------------------------
+// a dead process is destroyed at once, so that the killed ones do not pile
+// up as zombies in a long session
+void smt_process_pool_t::release(smt_process_t *p)
+{
+  std::lock_guard<std::mutex> lk(lock);
+  if ( p->alive() )
+  {
+    idle.push_back(p);
+    return;
+  }
+  destroy(p);
+  qstring errbuf;
+  smt_process_t *np = spawn(&errbuf);
+  if ( np != nullptr )
+    idle.push_back(np);
+}
+
+//-------------------------------------------------------------------------
+// the process may have been released and destroyed by its query meanwhile.
+// the serials are unique, so a new process at the same address is safe.
+void smt_process_pool_t::kill(smt_process_t *p, uint64 query_serial)
+{
+  std::lock_guard<std::mutex> lk(lock);
+  if ( all.has(p) )
+    p->kill(query_serial);
+}
+
+//-------------------------------------------------------------------------
+void smt_process_pool_t::shutdown()
+{
+  std::lock_guard<std::mutex> lk(lock);
+  for ( smt_process_t *p : all )
+    delete p;
+  all.clear();
+  idle.clear();
+}
@@ -0,0 +1,84 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <hexrays.hpp>
+
+// how long a z3 process may run past the timeout of its query, ms
+const int SMT_PROCESS_GRACE = 500;
+
+//-------------------------------------------------------------------------
+// a z3 process that reads SMT-LIB commands from its standard input. the
+// timeout of z3 is soft: a query may run far past it, and a crash of z3
+// would take IDA with it. this process is killed when its query exceeds
+// the deadline, and its output is read by a thread of its own, so the
+// query never waits longer than that.
+class smt_process_t
+{
+  void *handle = nullptr;
+  qhandle_t input = NULL_PIPE_HANDLE;   // the standard input of z3
+  qhandle_t output = NULL_PIPE_HANDLE;  // its standard output
+  std::thread reader;
+  std::mutex lock;
+  std::condition_variable cv;
+  qstrvec_t lines;      // read from z3, not received yet
+  bool eof = false;     // z3 exited or was killed
+  bool killed = false;
+  uint64 serial = 0;    // of the current query, see kill()
+
+  void read_output();
+
+public:
+  ~smt_process_t() { terminate(); }
+  // runs 'path -in -smt2'
+  bool start(const char *path, qstring *errbuf);
+  // kills the process and waits for the reader thread
+  void terminate();
+  bool alive();
+  bool was_killed();
+
+  // starts a new query, returns its serial
+  uint64 begin_query();
+  bool send(const qstring &text);
+  // returns false at the end of the output, e.g. when the process is
+  // killed because the deadline passed
+  bool receive(qstring *line, std::chrono::steady_clock::time_point deadline);
+  // kills the process if it still runs the query, may be called by any thread
+  void kill(uint64 query_serial);
+};
+
+//-------------------------------------------------------------------------
+// the idle processes are kept to hide the startup of z3
+class smt_process_pool_t
+{
+  std::mutex lock;
+  qvector<smt_process_t *> idle;
+  qvector<smt_process_t *> all;   // the idle and busy ones
+
+  smt_process_t *spawn(qstring *errbuf);
+  void destroy(smt_process_t *p);
+
+public:
+  qstring path;   // of the z3 executable, empty to use the z3 library
+
+  ~smt_process_pool_t() { shutdown(); }
+  bool enabled() const { return !path.empty(); }
+  // starts processes until there are 'n' idle ones
+  void warm_up(size_t n);
+  smt_process_t *acquire(qstring *errbuf);
+  // a dead process is destroyed and replaced by a new one
+  void release(smt_process_t *p);
+  // kills the process if it still runs the query, may be called by any thread
+  void kill(smt_process_t *p, uint64 query_serial);
+  void shutdown();
+};
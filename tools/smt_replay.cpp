@@ -0,0 +1,292 @@
+/*
+ *      Copyright (c) 2025 by Hex-Rays, support@hex-rays.com
+ *      ALL RIGHTS RESERVED.
+ *
+ *      gooMBA plugin for Hex-Rays Decompiler.
+ *
+ */
+
+// Replays the z3 checks saved with MBA_SMT_CAPTURE_DIR, with other solver
+// settings and thread counts, and prints the throughput and the latency
+// percentiles. It needs only the z3 library, not IDA:
+//
+//   g++ -O2 -std=c++17 -Iz3/include tools/smt_replay.cpp -Lz3/bin -lz3 -pthread -o smt_replay
+//
+// usage: smt_replay [options] dir
+//   -t ms       the timeout of each check (default: the captured one)
+//   -j n        the number of threads (default: 1)
+//   -s tactics  comma separated z3 tactics (default: the default solver)
+//   -r seed     the random seed
+//   -v          print each check
+//
+// The captured scripts are parsed as is; their set-option and check-sat
+// commands are ignored, the options above are used instead.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <z3++.h>
+
+//-------------------------------------------------------------------------
+struct options_t
+{
+  unsigned timeout = 0;   // ms, 0: the captured one
+  unsigned nthreads = 1;
+  std::string tactics;
+  unsigned seed = 0;
+  bool verbose = false;
+};
+
+//-------------------------------------------------------------------------
+// one captured check and its replay
+struct check_t
+{
+  std::string path;
+  std::string text;
+  std::string captured_result;  // "sat", "unsat", "unknown", or empty
+  long long captured_usecs = -1;
+  unsigned captured_timeout = 0;
+  std::string result;           // of the replay, "error" if it failed
+  long long usecs = 0;
+};
+
+//-------------------------------------------------------------------------
+// reads the "; key: value" lines at the top of the file
+static bool load_check(check_t *c, const std::string &path)
+{
+  std::ifstream in(path);
+  if ( !in )
+    return false;
+  std::stringstream ss;
+  ss << in.rdbuf();
+  c->path = path;
+  c->text = ss.str();
+
+  std::istringstream lines(c->text);
+  std::string line;
+  while ( std::getline(lines, line) && line.compare(0, 2, "; ") == 0 )
+  {
+    size_t colon = line.find(": ");
+    if ( colon == std::string::npos )
+      continue;
+    std::string key = line.substr(2, colon - 2);
+    std::string value = line.substr(colon + 2);
+    if ( key == "result" )
+      c->captured_result = value;
+    else if ( key == "time" )
+      c->captured_usecs = atoll(value.c_str());
+    else if ( key == "timeout" )
+      c->captured_timeout = atoi(value.c_str());
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+static z3::solver make_solver(z3::context &ctx, const options_t &opts)
+{
+  if ( opts.tactics.empty() )
+    return z3::solver(ctx);
+  std::istringstream names(opts.tactics);
+  std::string name;
+  std::getline(names, name, ',');
+  z3::tactic t(ctx, name.c_str());
+  while ( std::getline(names, name, ',') )
+    t = t & z3::tactic(ctx, name.c_str());
+  return t.mk_solver();
+}
+
+//-------------------------------------------------------------------------
+static void replay(check_t *c, const options_t &opts)
+{
+  try
+  {
+    z3::context ctx;
+    z3::expr_vector facts = ctx.parse_string(c->text.c_str());
+    z3::solver s = make_solver(ctx, opts);
+    z3::params p(ctx);
+    p.set("timeout", opts.timeout != 0 ? opts.timeout : c->captured_timeout);
+    if ( opts.seed != 0 )
+      p.set("random_seed", opts.seed);
+    s.set(p);
+    s.add(facts);
+    auto start = std::chrono::steady_clock::now();
+    z3::check_result res = s.check();
+    auto end = std::chrono::steady_clock::now();
+    c->usecs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    c->result = res == z3::sat ? "sat" : res == z3::unsat ? "unsat" : "unknown";
+  }
+  catch ( const z3::exception &e )
+  {
+    fprintf(stderr, "%s: %s\n", c->path.c_str(), e.msg());
+    c->result = "error";
+  }
+}
+
+//-------------------------------------------------------------------------
+// the nearest-rank percentile of the sorted values
+static long long percentile(const std::vector<long long> &sorted, double pct)
+{
+  if ( sorted.empty() )
+    return 0;
+  size_t rank = size_t(pct / 100 * sorted.size() + 0.999999);
+  rank = std::max<size_t>(rank, 1);
+  return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+//-------------------------------------------------------------------------
+static void print_latencies(const char *title, std::vector<long long> usecs)
+{
+  std::sort(usecs.begin(), usecs.end());
+  if ( usecs.empty() )
+    return;
+  printf("%-9s p50 %lld us, p90 %lld us, p99 %lld us, max %lld us\n",
+         title,
+         percentile(usecs, 50),
+         percentile(usecs, 90),
+         percentile(usecs, 99),
+         usecs.back());
+}
+
+//-------------------------------------------------------------------------
+static void usage()
+{
+  fprintf(stderr, "usage: smt_replay [-t timeout_ms] [-j threads] [-s tactics] [-r seed] [-v] dir\n");
+  exit(1);
+}
+
+//-------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  options_t opts;
+  const char *dir = nullptr;
+  for ( int i = 1; i < argc; i++ )
+  {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if ( strcmp(arg, "-t") == 0 && has_value )
+      opts.timeout = atoi(argv[++i]);
+    else if ( strcmp(arg, "-j") == 0 && has_value )
+      opts.nthreads = std::max(atoi(argv[++i]), 1);
+    else if ( strcmp(arg, "-s") == 0 && has_value )
+      opts.tactics = argv[++i];
+    else if ( strcmp(arg, "-r") == 0 && has_value )
+      opts.seed = atoi(argv[++i]);
+    else if ( strcmp(arg, "-v") == 0 )
+      opts.verbose = true;
+    else if ( arg[0] != '-' && dir == nullptr )
+      dir = arg;
+    else
+      usage();
+  }
+  if ( dir == nullptr )
+    usage();
+
+  std::vector<std::string> paths;
+  std::error_code ec;
+  for ( const auto &entry : std::filesystem::directory_iterator(dir, ec) )
+    if ( entry.path().extension() == ".smt2" )
+      paths.push_back(entry.path().string());
+  if ( ec )
+  {
+    fprintf(stderr, "%s: %s\n", dir, ec.message().c_str());
+    return 1;
+  }
+  std::sort(paths.begin(), paths.end());
+
+  std::vector<check_t> checks;
+  for ( const std::string &path : paths )
+  {
+    check_t c;
+    if ( load_check(&c, path) )
+      checks.push_back(c);
+    else
+      fprintf(stderr, "%s: cannot read\n", path.c_str());
+  }
+  if ( checks.empty() )
+  {
+    fprintf(stderr, "%s: no .smt2 files\n", dir);
+    return 1;
+  }
+
+  std::atomic<size_t> next(0);
+  std::mutex print_lock;
+  auto worker = [&]()
+  {
+    size_t i;
+    while ( (i = next++) < checks.size() )
+    {
+      replay(&checks[i], opts);
+      if ( opts.verbose )
+      {
+        std::lock_guard<std::mutex> guard(print_lock);
+        printf("%s: %s, %lld us (captured: %s, %lld us)\n",
+               checks[i].path.c_str(),
+               checks[i].result.c_str(),
+               checks[i].usecs,
+               checks[i].captured_result.c_str(),
+               checks[i].captured_usecs);
+      }
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for ( unsigned k = 0; k < opts.nthreads; k++ )
+    threads.emplace_back(worker);
+  for ( std::thread &t : threads )
+    t.join();
+  auto end = std::chrono::steady_clock::now();
+  double secs = std::chrono::duration<double>(end - start).count();
+
+  // a definite answer that differs from the captured one is a solver bug
+  // or a capture of a different query
+  int nsat = 0;
+  int nunsat = 0;
+  int nunknown = 0;
+  int nerrors = 0;
+  int nconflicts = 0;
+  int ngained = 0;    // unknown before, definite now
+  int nlost = 0;      // definite before, unknown now
+  std::vector<long long> usecs;
+  std::vector<long long> captured_usecs;
+  for ( const check_t &c : checks )
+  {
+    if ( c.result == "error" )
+    {
+      nerrors++;
+      continue;
+    }
+    nsat += c.result == "sat";
+    nunsat += c.result == "unsat";
+    nunknown += c.result == "unknown";
+    usecs.push_back(c.usecs);
+    if ( c.captured_usecs >= 0 )
+      captured_usecs.push_back(c.captured_usecs);
+    bool was_definite = c.captured_result == "sat" || c.captured_result == "unsat";
+    bool is_definite = c.result != "unknown";
+    if ( was_definite && is_definite && c.result != c.captured_result )
+    {
+      nconflicts++;
+      fprintf(stderr, "%s: %s, captured %s\n", c.path.c_str(), c.result.c_str(), c.captured_result.c_str());
+    }
+    ngained += !was_definite && is_definite;
+    nlost += was_definite && !is_definite;
+  }
+
+  printf("checks:   %zu in %.3f s with %u threads, %.1f checks/s\n",
+         checks.size(), secs, opts.nthreads, checks.size() / secs);
+  printf("results:  %d unsat, %d sat, %d unknown, %d errors\n", nunsat, nsat, nunknown, nerrors);
+  printf("captured: %d newly decided, %d no longer decided, %d conflicting\n", ngained, nlost, nconflicts);
+  print_latencies("replay:", usecs);
+  print_latencies("captured:", captured_usecs);
+  return nconflicts != 0 ? 2 : 0;
+}